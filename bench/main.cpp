@@ -0,0 +1,215 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "kb390l.h"
+#include "kb390lsimulator.h"
+#include "qhiddevice.h"
+#include "qhidstats.h"
+
+#include <QBuffer>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+// Every iteration rewrites the keyboard NAND, spare it.
+#define HARDWARE_ITERATIONS 3
+
+// One JSON object per line, so the results can be compared between releases:
+// {"benchmark":"flag-get","device":"simulator","iterations":100,"seconds":0.01,
+//  "ops_per_sec":10000,"bytes_per_sec":1800000,"transfers":200,"p50_us":95,"p99_us":130}
+static bool run(const QString &name, const QString &device, int iterations, const std::function<bool(int)> &op)
+{
+    std::vector<qint64> latencies;
+    latencies.reserve(size_t(iterations));
+
+    auto stats = QHIDStats::instance();
+    stats->reset();
+
+    QElapsedTimer total;
+    total.start();
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        if (!op(i))
+        {
+            qWarning() << qPrintable(device + ": " + name) << "failed at iteration" << i;
+            return false;
+        }
+
+        latencies.push_back(timer.nsecsElapsed() / 1000);
+    }
+
+    auto seconds = total.nsecsElapsed() / 1e9;
+    quint64 bytes = 0;
+    quint64 transfers = 0;
+
+    // The transfers only, the sleeps are the last.
+    for (int i = 0; i < QHIDStats::Sleep; ++i)
+    {
+        bytes += stats->bytes(QHIDStats::Operation(i));
+        transfers += stats->count(QHIDStats::Operation(i));
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](int percent) { return double(latencies[(latencies.size() - 1) * size_t(percent) / 100]); };
+
+    QJsonObject result;
+    result["benchmark"] = name;
+    result["device"] = device;
+    result["iterations"] = iterations;
+    result["seconds"] = seconds;
+    result["ops_per_sec"] = seconds > 0 ? iterations / seconds : 0;
+    result["bytes_per_sec"] = seconds > 0 ? bytes / seconds : 0;
+    result["transfers"] = double(transfers);
+    result["p50_us"] = percentile(50);
+    result["p99_us"] = percentile(99);
+
+    QTextStream(stdout) << QJsonDocument(result).toJson(QJsonDocument::Compact) << "\n";
+    return true;
+}
+
+static bool runSuite(KB390L &kb, const QString &device, int iterations)
+{
+    // Every benchmark but the writes starts from the cold cache, so the device is actually asked.
+    QByteArray config;
+    QBuffer original(&config);
+    if (!original.open(QBuffer::WriteOnly) || !kb.backupConfig(&original))
+    {
+        qWarning() << qPrintable(device + ":") << "failed to read the config";
+        return false;
+    }
+
+    auto ok = run("flag-get", device, iterations, [&](int) {
+        kb.invalidateCache();
+        return kb.reportRate() >= 0;
+    });
+
+    ok = ok && run("flag-set", device, iterations, [&](int i) {
+        auto value = i % (KB390L::MaxReportRate + 1);
+        kb.setReportRate(value);
+        return kb.reportRate() == value;
+    });
+
+    ok = ok && run("button-save", device, iterations, [&](int) {
+        kb.invalidateCache();
+        auto value = kb.button(KB390L::KeyA);
+        kb.setButton(KB390L::KeyA, value ^ 1);
+        return value != -1 && kb.save();
+    });
+
+    ok = ok && run("macro-round-trip", device, iterations, [&](int i) {
+        auto index = i % (KB390L::MaxMacroNum + 1);
+        QByteArray macro(PageCache::MacroSize, char(i));
+        kb.setMacro(index, macro);
+        if (!kb.save())
+            return false;
+
+        kb.invalidateCache();
+        return kb.macroView(index) == PageView(macro);
+    });
+
+    ok = ok && run("backup", device, iterations, [&](int) {
+        QBuffer buffer;
+        kb.invalidateCache();
+        return buffer.open(QBuffer::WriteOnly) && kb.backupConfig(&buffer);
+    });
+
+    ok = ok && run("restore", device, iterations, [&](int) {
+        QBuffer buffer(&config);
+        return buffer.open(QBuffer::ReadOnly) && kb.restoreConfig(&buffer);
+    });
+
+    // Leave the device as it was.
+    QBuffer buffer(&config);
+    if (!buffer.open(QBuffer::ReadOnly) || !kb.restoreConfig(&buffer))
+    {
+        qWarning() << qPrintable(device + ":") << "failed to restore the config";
+        return false;
+    }
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(PRODUCT_NAME);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("HV-KB390L protocol benchmarks");
+    parser.addHelpOption();
+
+    QCommandLineOption iterationsOption(
+        QStringList() << "n" << "iterations", "The number of <iterations> per benchmark.", "iterations", "100");
+    parser.addOption(iterationsOption);
+    QCommandLineOption latencyOption(
+        QStringList() << "latency", "The simulated duration of a transfer, <usecs>.", "usecs", "0");
+    parser.addOption(latencyOption);
+    QCommandLineOption hardwareOption(
+        QStringList() << "hardware",
+        "Also run on the attached keyboard, at most " + QString::number(HARDWARE_ITERATIONS)
+            + " iterations. Its config is restored afterwards.");
+    parser.addOption(hardwareOption);
+    QCommandLineOption adaptivePacingOption(
+        QStringList() << "adaptive-pacing", "Wait for the ping answer after the writes instead of the fixed delay.");
+    parser.addOption(adaptivePacingOption);
+    parser.process(app);
+
+    auto iterations = qMax(1, parser.value(iterationsOption).toInt());
+    int ret = 0;
+
+    {
+        KB390LSimulator sim;
+        sim.setLatency(parser.value(latencyOption).toInt());
+        KB390L kb(new QHIDDevice(sim.genericTransport()), new QHIDDevice(sim.eventTransport()));
+        // The simulator does queue the page requests.
+        kb.setPipelineDepth(4);
+        kb.setAdaptivePacing(parser.isSet(adaptivePacingOption));
+
+        if (!runSuite(kb, "simulator", iterations))
+            ret = 1;
+    }
+
+    if (parser.isSet(hardwareOption))
+    {
+        KB390L kb;
+        kb.setAdaptivePacing(parser.isSet(adaptivePacingOption));
+
+        if (!kb.ping())
+        {
+            qWarning() << "The device was not found.";
+        }
+        else if (!runSuite(kb, "hardware", qMin(iterations, HARDWARE_ITERATIONS)))
+        {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
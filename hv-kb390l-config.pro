@@ -24,7 +24,7 @@ lessThan(QT_MAJOR_VERSION, 5) \
 isEmpty(PREFIX): PREFIX   = /usr
 DEFINES += PREFIX=$$PREFIX
 CONFIG  += c++11
-QT      += core gui widgets
+QT      += core gui network widgets
 
 include (libqhid/libqhid.pri)
 
@@ -36,6 +36,8 @@ DEFINES += PRODUCT_NAME=\\\"$$TARGET\\\" \
     PRODUCT_VERSION=\\\"$$VERSION\\\"
 
 SOURCES += src/buttonedit.cpp \
+    src/commandinterpreter.cpp \
+    src/daemon.cpp \
     src/enumedit.cpp \
     src/macroedit.cpp \
     src/main.cpp \
@@ -43,19 +45,26 @@ SOURCES += src/buttonedit.cpp \
     src/mousebuttonbox.cpp \
     src/kb390l.cpp \
     src/pagelight.cpp \
+    src/pagecache.cpp \
     src/pagemacro.cpp \
+    src/profile.cpp \
     src/usbcommandedit.cpp \
     src/usbscancodeedit.cpp \
     src/pagespeed.cpp
 
 HEADERS  += src/buttonedit.h \
+    src/commandinterpreter.h \
+    src/daemon.h \
     src/enumedit.h \
     src/macroedit.h \
     src/mainwindow.h \
     src/mousebuttonbox.h \
     src/kb390l.h \
     src/pagelight.h \
+    src/pagecache.h \
+    src/pagelayout.h \
     src/pagemacro.h \
+    src/profile.h \
     src/usbcommandedit.h \
     src/usbscancodeedit.h \
     src/pagespeed.h \
@@ -91,3 +100,10 @@ udev.files = 51-hv-kb390l-keyboard.rules
 udev.path = /etc/udev/rules.d
 
 INSTALLS += target man icon shortcut udev
+
+# make bench: build and run the protocol benchmarks against the simulated device.
+# Pass BENCH_ARGS="--hardware" to run them on the attached keyboard too.
+# Built out of the source tree, bench/ is the sources.
+bench.commands = $(MKDIR) $$OUT_PWD/bench-build && cd $$OUT_PWD/bench-build \
+    && $(QMAKE) $$PWD/bench/bench.pro && $(MAKE) && ./hv-kb390l-bench $(BENCH_ARGS)
+QMAKE_EXTRA_TARGETS += bench
@@ -22,15 +22,26 @@ INCLUDEPATH += $$PWD
 
 HEADERS += \
     $$PWD/qhiddevice.h \
-    $$PWD/qhidmonitor.h
+    $$PWD/qhidmonitor.h \
+    $$PWD/qhidreportdescriptor.h \
+    $$PWD/qhidstats.h \
+    $$PWD/qhidtransport.h
 
 SOURCES += \
     $$PWD/qhiddevice.cpp \
-    $$PWD/qhidmonitor.cpp
+    $$PWD/qhidmonitor.cpp \
+    $$PWD/qhidreportdescriptor.cpp \
+    $$PWD/qhidstats.cpp
 
 CONFIG += link_pkgconfig
 
 OPTIONAL_MODULES = hidapi hidapi-libusb libusb-1.0 libudev
+
+# qmake CONFIG+=hidraw talks to /dev/hidrawN directly, without the hidapi.
+linux:hidraw {
+  OPTIONAL_MODULES -= hidapi hidapi-libusb
+  DEFINES += WITH_HIDRAW
+}
 for (mod, OPTIONAL_MODULES) {
   modVer = $$system(pkg-config --silence-errors --modversion $$mod)
   !isEmpty(modVer) {
@@ -56,7 +67,11 @@ else {
   error("Need libudev or libusb-1.0 development package.")
 }
 
-contains(DEFINES, WITH_HIDAPI) || contains(DEFINES, WITH_HIDAPI_LIBUSB) {
+contains(DEFINES, WITH_HIDRAW) {
+  SOURCES += $$PWD/qhiddevice_hidraw.cpp
+  HEADERS += $$PWD/qhiddevice_hidraw.h
+}
+else:contains(DEFINES, WITH_HIDAPI) || contains(DEFINES, WITH_HIDAPI_LIBUSB) {
   SOURCES += $$PWD/qhiddevice_hidapi.cpp
   HEADERS += $$PWD/qhiddevice_hidapi.h
 }
@@ -66,5 +81,5 @@ else:win32 {
   LIBS += -lhid -lsetupapi
 }
 else {
-  error("Need hidapi or hidapi-libusb development package.")
+  error("Need hidapi or hidapi-libusb development package, or CONFIG+=hidraw.")
 }
@@ -17,7 +17,11 @@
  */
 
 #include "qhiddevice.h"
-#if defined(WITH_HIDAPI) || defined(WITH_HIDAPI_LIBUSB) || defined(WITH_HIDAPI_HIDRAW)
+#include "qhidstats.h"
+#include "qhidtransport.h"
+#if defined(WITH_HIDRAW)
+#include "qhiddevice_hidraw.h"
+#elif defined(WITH_HIDAPI) || defined(WITH_HIDAPI_LIBUSB) || defined(WITH_HIDAPI_HIDRAW)
 #include "qhiddevice_hidapi.h"
 #elif defined(Q_OS_WIN32)
 #include "qhiddevice_win32.h"
@@ -26,73 +30,282 @@
 #include <QDebug>
 #include <QThread>
 
-QHIDDevice::QHIDDevice(int vendorId, int deviceId, int usagePage, int usage, QObject *parent)
+#include <string.h>
+
+// Adaptive pacing: retries before falling back to the fixed delay,
+#define PACING_MAX_ATTEMPTS 5
+// the first back off step,
+#define PACING_MIN_BACKOFF 500
+// the number of successful transfers before the delay is reduced,
+#define PACING_DECAY_COUNT 8
+// the delay it is never reduced below,
+#define PACING_MIN_DELAY 1000
+// and before the fixed delay is given up again.
+#define PACING_RECOVER_COUNT 64
+
+static void sleepUsecs(qint64 usecs, bool instrumented)
+{
+    QHIDStats::Timer timer(QHIDStats::Sleep, 0, instrumented);
+    QThread::usleep(ulong(usecs));
+    timer.done(0);
+}
+
+QHIDDevice::QHIDDevice(int vendorId, int deviceId, int usagePage, int usage, const QString &path, QObject *parent)
+    : QObject(parent)
+    , inputBufferLength(64)
+    , outputBufferLength(64)
+    , writeDelayValue(20)
+    , readTimeoutValue(3000)
+    , pacingValue(FixedPacing)
+    , pacingFallback(false)
+    , learnedDelayValue(20 * 1000)
+    , successCount(0)
+    , instrumentedValue(true)
+    , d_ptr(new QHIDDevicePrivate(this, vendorId, deviceId, usagePage, usage, path))
+    , transport(d_ptr)
+{
+}
+
+QHIDDevice::QHIDDevice(QHIDTransport *transport, QObject *parent)
     : QObject(parent)
     , inputBufferLength(64)
     , outputBufferLength(64)
     , writeDelayValue(20)
     , readTimeoutValue(3000)
-    , d_ptr(new QHIDDevicePrivate(this, vendorId, deviceId, usagePage, usage))
+    , pacingValue(FixedPacing)
+    , pacingFallback(false)
+    , learnedDelayValue(20 * 1000)
+    , successCount(0)
+    , instrumentedValue(true)
+    , d_ptr(nullptr)
+    , transport(transport)
 {
 }
 
 QHIDDevice::~QHIDDevice()
 {
-    d_ptr->q_ptr = nullptr;
-    delete d_ptr;
-    d_ptr = nullptr;
+    if (d_ptr)
+    {
+        d_ptr->q_ptr = nullptr;
+        delete d_ptr;
+        d_ptr = nullptr;
+    }
+    transport = nullptr;
+}
+
+QStringList QHIDDevice::enumerate(int vendorId, int deviceId)
+{
+    return QHIDDevicePrivate::enumerate(vendorId, deviceId);
 }
 
-bool QHIDDevice::open(int vendorId, int deviceId, int usagePage, int usage)
+bool QHIDDevice::open(int vendorId, int deviceId, int usagePage, int usage, const QString &path)
 {
+    if (!d_ptr)
+    {
+        // Custom transport, nothing to reopen.
+        return transport->isValid();
+    }
+
+    // A new device, learn its timings from scratch.
+    pacingFallback = false;
+    learnedDelayValue = writeDelayValue * 1000;
+    successCount = 0;
+    lastTransfer.invalidate();
+
     d_ptr->q_ptr = nullptr;
     delete d_ptr;
-    d_ptr = new QHIDDevicePrivate(this, vendorId, deviceId, usagePage, usage);
+    transport = d_ptr = new QHIDDevicePrivate(this, vendorId, deviceId, usagePage, usage, path);
     return d_ptr->isValid();
 }
 
+bool QHIDDevice::canEnumerate()
+{
+    return QHIDDevicePrivate::canEnumerate();
+}
+
+QString QHIDDevice::path() const
+{
+    return d_ptr ? d_ptr->path() : QString();
+}
+
 bool QHIDDevice::isValid() const
 {
-    Q_D(const QHIDDevice);
-    return d->isValid();
+    return transport->isValid();
 }
 
-int QHIDDevice::sendFeatureReport(const char *report, int length)
+int QHIDDevice::handle() const
 {
-    Q_D(QHIDDevice);
-    auto ret = d->sendFeatureReport(report, length);
-    if (writeDelayValue > 0)
-        QThread::msleep(ulong(writeDelayValue));
+    return transport->handle();
+}
+
+bool QHIDDevice::isAdaptive() const
+{
+    // Without the probe nothing tells the device has completed the write.
+    return pacingValue == AdaptivePacing && !pacingFallback && readyProbeValue.length() > 1;
+}
+
+int QHIDDevice::paced(const std::function<int()> &transfer, bool delayed)
+{
+    if (isAdaptive())
+    {
+        for (int attempt = 0; attempt < PACING_MAX_ATTEMPTS; ++attempt)
+        {
+            if (lastTransfer.isValid())
+            {
+                auto elapsed = lastTransfer.nsecsElapsed() / 1000;
+                if (elapsed < learnedDelayValue)
+                    sleepUsecs(learnedDelayValue - elapsed, instrumentedValue);
+            }
+
+            auto ret = transfer();
+            lastTransfer.start();
+            learn(ret > 0);
+
+            if (ret > 0)
+                return ret;
+        }
+
+        qWarning() << "The device does not keep up, falling back to the fixed delay" << writeDelayValue;
+        pacingFallback = true;
+        if (writeDelayValue > 0)
+            sleepUsecs(writeDelayValue * 1000LL, instrumentedValue);
+    }
+
+    auto ret = transfer();
+    if (delayed && writeDelayValue > 0)
+        sleepUsecs(writeDelayValue * 1000LL, instrumentedValue);
+
+    if (pacingValue == AdaptivePacing)
+    {
+        // The device keeps up with the fixed delay, give the adaptive pacing another chance.
+        lastTransfer.start();
+        successCount = ret > 0 ? successCount + 1 : 0;
+        if (successCount >= PACING_RECOVER_COUNT)
+        {
+            pacingFallback = false;
+            learnedDelayValue = writeDelayValue * 1000;
+            successCount = 0;
+        }
+    }
+
     return ret;
 }
 
+void QHIDDevice::learn(bool success)
+{
+    if (success)
+    {
+        // Try to go a bit faster after a series of successful transfers.
+        if (++successCount >= PACING_DECAY_COUNT)
+        {
+            learnedDelayValue = qMax(PACING_MIN_DELAY, learnedDelayValue * 3 / 4);
+            successCount = 0;
+        }
+    }
+    else
+    {
+        // Exponential back off, but never slower than the fixed delay.
+        auto maxDelay = qMax(writeDelayValue * 1000, PACING_MIN_BACKOFF);
+        learnedDelayValue = qBound(PACING_MIN_BACKOFF, learnedDelayValue * 2, maxDelay);
+        successCount = 0;
+    }
+}
+
+bool QHIDDevice::probeReady()
+{
+    auto length = readyProbeValue.length();
+    if (rxProbe.size() != length)
+        rxProbe.resize(length);
+
+    QHIDStats::Timer send(QHIDStats::SendFeatureReport, readyProbeValue.at(1), instrumentedValue);
+    if (send.done(transport->sendFeatureReport(readyProbeValue.constData(), length)) != length)
+        return false;
+
+    rxProbe.fill('\x0');
+    QHIDStats::Timer get(QHIDStats::GetFeatureReport, readyProbeValue.at(1), instrumentedValue);
+    return get.done(transport->getFeatureReport(rxProbe.data(), length)) == length
+        && rxProbe.at(1) == readyProbeValue.at(1);
+}
+
+bool QHIDDevice::waitReady()
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto limit = writeDelayValue * 1000LL;
+    auto interval = qint64(PACING_MIN_DELAY);
+
+    while (!probeReady())
+    {
+        auto elapsed = timer.nsecsElapsed() / 1000;
+        if (elapsed >= limit)
+            return false;
+
+        sleepUsecs(qMin(interval, limit - elapsed), instrumentedValue);
+        interval *= 2;
+    }
+
+    lastTransfer.start();
+    return true;
+}
+
+int QHIDDevice::sendFeatureReport(const char *report, int length)
+{
+    return paced(
+        [&]() {
+            QHIDStats::Timer timer(QHIDStats::SendFeatureReport, length > 1 ? report[1] : 0, instrumentedValue);
+            return timer.done(transport->sendFeatureReport(report, length));
+        },
+        true);
+}
+
 int QHIDDevice::getFeatureReport(char *report, int length)
 {
-    Q_D(QHIDDevice);
-    return d->getFeatureReport(report, length);
+    // In adaptive mode a failed request means the device is not ready yet, so poll it.
+    return paced(
+        [&]() {
+            QHIDStats::Timer timer(QHIDStats::GetFeatureReport, length > 1 ? report[1] : 0, instrumentedValue);
+            return timer.done(transport->getFeatureReport(report, length));
+        },
+        false);
 }
 
 int QHIDDevice::write(char report, const char *buffer, int length)
 {
-    Q_D(QHIDDevice);
     int offset = 0;
 
+    // The backend may have changed the buffer length on open, allocate once per device.
+    if (txBuffer.size() != outputBufferLength + 1)
+        txBuffer.resize(outputBufferLength + 1);
+
+    auto chunk = txBuffer.data();
+    chunk[0] = report;
+
     while (length > 0)
     {
-        QByteArray chunk;
-        chunk.reserve(outputBufferLength);
-        chunk.append(report).append(buffer + offset, qMin(length, outputBufferLength));
-        auto written = d->write(chunk.cbegin(), chunk.size());
+        auto size = qMin(length, outputBufferLength);
+        memcpy(chunk + 1, buffer + offset, size_t(size));
+        auto written = paced(
+            [&]() {
+                QHIDStats::Timer timer(QHIDStats::Write, report, instrumentedValue);
+                return timer.done(transport->write(chunk, size + 1));
+            },
+            true);
 
         if (written <= 0)
             return written;
 
-        if (writeDelayValue > 0)
-            QThread::msleep(ulong(writeDelayValue));
         offset += written - 1;
         length -= written - 1;
     }
 
+    // The chunks only have to be accepted, the whole write has to be completed.
+    // Not answering within the fixed delay is as good as the fixed pacing, stay with it.
+    if (isAdaptive() && !waitReady())
+    {
+        qWarning() << "The device does not answer the probe, falling back to the fixed delay" << writeDelayValue;
+        pacingFallback = true;
+    }
+
     return offset;
 }
 
@@ -103,12 +316,12 @@ int QHIDDevice::read(char *buffer, int length)
 
 int QHIDDevice::read(char *buffer, int length, int readTimeout)
 {
-    Q_D(QHIDDevice);
     int offset = 0;
 
     while (length > 0)
     {
-        auto read = d->read(buffer + offset, length, readTimeout);
+        QHIDStats::Timer timer(QHIDStats::Read, 0, instrumentedValue);
+        auto read = timer.done(transport->read(buffer + offset, length, readTimeout));
 
         if (read <= 0)
             return read;
@@ -138,4 +351,45 @@ int QHIDDevice::writeDelay() const
 void QHIDDevice::setWriteDelay(int value)
 {
     writeDelayValue = value;
+    // The adaptive pacing starts from the fixed delay and goes down from there.
+    learnedDelayValue = value * 1000;
+    successCount = 0;
+}
+
+QHIDDevice::Pacing QHIDDevice::pacing() const
+{
+    return pacingValue;
+}
+
+void QHIDDevice::setPacing(Pacing value)
+{
+    pacingValue = value;
+    pacingFallback = false;
+    learnedDelayValue = writeDelayValue * 1000;
+    successCount = 0;
+}
+
+QByteArray QHIDDevice::readyProbe() const
+{
+    return readyProbeValue;
+}
+
+void QHIDDevice::setReadyProbe(const QByteArray &report)
+{
+    readyProbeValue = report;
+}
+
+int QHIDDevice::learnedDelay() const
+{
+    return learnedDelayValue;
+}
+
+bool QHIDDevice::instrumented() const
+{
+    return instrumentedValue;
+}
+
+void QHIDDevice::setInstrumented(bool value)
+{
+    instrumentedValue = value;
 }
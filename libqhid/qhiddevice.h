@@ -19,24 +19,59 @@
 #ifndef QHIDDEVICE_H
 #define QHIDDEVICE_H
 
+#include <QByteArray>
+#include <QElapsedTimer>
 #include <QObject>
+#include <QStringList>
+
+#include <functional>
 
 class QHIDDevicePrivate;
+class QHIDTransport;
 class QHIDDevice : public QObject
 {
     Q_PROPERTY(int writeDelay READ writeDelay WRITE setWriteDelay)
     Q_PROPERTY(int readTimeout READ readTimeout WRITE setReadTimeout)
+    Q_PROPERTY(Pacing pacing READ pacing WRITE setPacing)
+    Q_PROPERTY(QByteArray readyProbe READ readyProbe WRITE setReadyProbe)
+    Q_PROPERTY(int learnedDelay READ learnedDelay)
+    Q_PROPERTY(bool instrumented READ instrumented WRITE setInstrumented)
 
     Q_OBJECT
     Q_DECLARE_PRIVATE(QHIDDevice)
+    Q_ENUMS(Pacing)
 
 public:
-    QHIDDevice(int vendorId, int deviceId, int usagePage, int usage, QObject *parent = 0);
+    enum Pacing
+    {
+        // Sleep for writeDelay after every write.
+        FixedPacing,
+        // Send as soon as the device accepts the transfer, back off on failures,
+        // and poll the ready probe after every write. Fixed without the probe.
+        AdaptivePacing,
+    };
+
+    // The path selects one of several identical devices, see enumerate(). Empty for the first one found.
+    QHIDDevice(int vendorId, int deviceId, int usagePage, int usage, const QString &path = QString(),
+        QObject *parent = 0);
+    // Use a custom transport instead of the platform one. The transport is not owned.
+    explicit QHIDDevice(QHIDTransport *transport, QObject *parent = 0);
     ~QHIDDevice();
 
-    bool open(int vendorId, int deviceId, int usagePage, int usage);
+    // The paths of the attached devices, one per physical device.
+    static QStringList enumerate(int vendorId, int deviceId);
+    // False if the backend can not tell the physical devices apart, so enumerate() lists nothing.
+    static bool canEnumerate();
+
+    // The path of the opened device as enumerate() lists it, empty if the backend can not tell.
+    QString path() const;
+
+    bool open(int vendorId, int deviceId, int usagePage, int usage, const QString &path = QString());
     bool isValid() const;
 
+    // See QHIDTransport::handle().
+    int handle() const;
+
     int sendFeatureReport(const char *report, int length);
     int getFeatureReport(char *report, int length);
 
@@ -50,12 +85,46 @@ public:
     int writeDelay() const;
     void setWriteDelay(int value);
 
+    Pacing pacing() const;
+    void setPacing(Pacing value);
+
+    // The feature report the device answers only when it has completed the
+    // previous write, e.g. a ping. The answer echoes the byte 1 of the request.
+    QByteArray readyProbe() const;
+    void setReadyProbe(const QByteArray &report);
+
+    // The minimum safe delay between transfers, in microseconds.
+    int learnedDelay() const;
+
+    // Record the calls in QHIDStats. Off for the devices which mostly wait for events.
+    bool instrumented() const;
+    void setInstrumented(bool value);
+
+private:
+    bool isAdaptive() const;
+    int paced(const std::function<int()> &transfer, bool delayed);
+    void learn(bool success);
+    bool probeReady();
+    // Polls the probe until the device answers, at most writeDelay.
+    bool waitReady();
+
 protected:
     int inputBufferLength;
     int outputBufferLength;
     int writeDelayValue;
     int readTimeoutValue;
+    Pacing pacingValue;
+    bool pacingFallback;
+    int learnedDelayValue;
+    int successCount;
+    bool instrumentedValue;
+    QElapsedTimer lastTransfer;
+    // The report number and a chunk of data, reused for every write.
+    QByteArray txBuffer;
+    QByteArray readyProbeValue;
+    QByteArray rxProbe;
     class QHIDDevicePrivate *d_ptr;
+    QHIDTransport *transport;
 };
 
 #endif // QHIDDEVICE_H
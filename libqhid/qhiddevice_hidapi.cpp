@@ -18,90 +18,90 @@
 
 #include "qhiddevice.h"
 #include "qhiddevice_hidapi.h"
+#include "qhidreportdescriptor.h"
 
 #include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QRegExp>
 
 #include <errno.h>
 
 #ifdef WITH_LIBUSB_1_0
 #include <libusb.h>
 
-static bool findUsage(int usagePage, int usage, const uint8_t *desc, size_t size)
+// What we know about an interface of a device.
+struct InterfaceInfo
 {
-    unsigned int i = 0;
-    int dataLen, keySize;
-    bool usageMatch = false, pageMatch = false;
-
-    while (i < size)
+    QByteArray reportDescriptor;
+    int inBufferLength;
+    int outBufferLength;
+};
+
+// Descriptors of the interfaces seen so far, keyed by vendor, product, the physical path
+// and the interface number. Fetching them requires detaching the kernel driver & claiming
+// the interface, which is slow, so do that only once per interface.
+static QHash<QString, InterfaceInfo> descriptorCache;
+static QMutex descriptorCacheMutex;
+
+struct SharedContext
+{
+    SharedContext()
+        : ctx(nullptr)
     {
-        int key = desc[i];
-
-        if ((key & 0xf0) == 0xf0)
+        int rc = libusb_init(&ctx);
+        if (LIBUSB_SUCCESS != rc)
         {
-            /* This is a Long Item. The next byte contains the
-               length of the data section (value) for this key.
-               See the HID specification, version 1.11, section
-               6.2.2.3, titled "Long Items." */
-            dataLen = i + 1 < size ? desc[i + 1] : 0;
-            keySize = 3;
-        }
-        else
-        {
-            /* This is a Short Item. The bottom two bits of the
-               key contain the size code for the data section
-               (value) for this key.  Refer to the HID
-               specification, version 1.11, section 6.2.2.2,
-               titled "Short Items." */
-            dataLen = key & 0x3;
-            if (dataLen == 3)
-                ++dataLen; // 0,1,2,4
-            keySize = 1;
+            qWarning() << "libusb_init failed" << rc << libusb_error_name(rc);
+            ctx = nullptr;
         }
+    }
 
-        auto tag = (key & 0xfc);
-        if (tag == 0x04 || tag == 0x08)
-        {
-            if (i + dataLen >= size)
-            {
-                // Truncated report?
-                return false;
-            }
-
-            int value = 0;
-            for (int offset = dataLen; offset > 0; --offset)
-            {
-                value <<= 8;
-                value |= desc[i + offset];
-            }
-
-            if (tag == 0x04 && value == usagePage)
-                pageMatch = true;
-            else if (tag == 0x08 && value == usage)
-                usageMatch = true;
-
-            if (pageMatch && usageMatch)
-                return true;
-        }
+    // The context lives until the process exits.
+    libusb_context *ctx;
+};
 
-        // Skip over this key and it's associated data.
-        i += dataLen + keySize;
-    }
+Q_GLOBAL_STATIC(SharedContext, sharedContextInstance)
 
-    return false;
+static libusb_context *sharedContext()
+{
+    return sharedContextInstance()->ctx;
 }
 
-static void hidapiMissingFeatures(
-    int vendorId, int deviceId, int usagePage, int usage, int *interfaceNumber, int *inBufferLength, int *outBufferLength)
+static QString usbPortPath(libusb_device *dev)
 {
-    libusb_context *ctx = nullptr;
-    int rc = libusb_init(&ctx);
-    if (LIBUSB_SUCCESS != rc)
+    // 1-2.3, as the kernel names it
+    uint8_t ports[16];
+    auto path = QString::number(libusb_get_bus_number(dev));
+
+    int count = libusb_get_port_numbers(dev, ports, sizeof(ports));
+    for (int i = 0; i < count; ++i)
     {
-        qWarning() << "libusb_init failed" << rc << libusb_error_name(rc);
-        return;
+        path.append(i == 0 ? '-' : '.').append(QString::number(ports[i]));
     }
 
+    return path;
+}
+
+static bool matchPath(libusb_device *dev, const QString &path)
+{
+    // Either the port path (the hidraw flavour) or the bus:address (the libusb one).
+    return path.isEmpty() || path == usbPortPath(dev)
+        || path == QString("%1:%2").arg(libusb_get_bus_number(dev), 4, 16, QChar('0'))
+                       .arg(libusb_get_device_address(dev), 4, 16, QChar('0'));
+}
+
+// The device at the physical path, referenced, or nullptr.
+static libusb_device *findDevice(int vendorId, int deviceId, const QString &physicalPath)
+{
+    auto ctx = sharedContext();
+    if (!ctx)
+        return nullptr;
+
     libusb_device **devs;
+    libusb_device *found = nullptr;
     auto count = libusb_get_device_list(ctx, &devs);
 
     for (ssize_t i = 0; i < count; ++i)
@@ -112,141 +112,300 @@ static void hidapiMissingFeatures(
         if (libusb_get_device_descriptor(dev, &desc) < 0)
             continue;
 
-        if (desc.idVendor != vendorId || desc.idProduct != deviceId)
-            continue;
+        if (desc.idVendor == vendorId && desc.idProduct == deviceId && matchPath(dev, physicalPath))
+        {
+            found = libusb_ref_device(dev);
+            break;
+        }
+    }
 
-        libusb_config_descriptor *confDesc = nullptr;
+    libusb_free_device_list(devs, 1);
+    return found;
+}
 
-        if (libusb_get_active_config_descriptor(dev, &confDesc) < 0)
-            continue;
+static bool readInterface(libusb_device *dev, int iface, InterfaceInfo *info)
+{
+    libusb_config_descriptor *confDesc = nullptr;
 
-        libusb_device_handle *handle;
-        if (libusb_open(dev, &handle) < 0)
-            continue;
+    if (libusb_get_active_config_descriptor(dev, &confDesc) < 0)
+        return false;
+
+    if (iface >= confDesc->bNumInterfaces || confDesc->interface[iface].num_altsetting < 1
+        || confDesc->interface[iface].altsetting[0].bInterfaceClass != LIBUSB_CLASS_HID)
+    {
+        libusb_free_config_descriptor(confDesc);
+        return false;
+    }
+
+    libusb_device_handle *handle;
+    if (libusb_open(dev, &handle) < 0)
+    {
+        libusb_free_config_descriptor(confDesc);
+        return false;
+    }
+
+    // Only this interface is taken from the kernel, and only for the time of the request.
+    bool detached = false;
+    int rc = libusb_kernel_driver_active(handle, iface);
+    if (rc == 1)
+    {
+        rc = libusb_detach_kernel_driver(handle, iface);
+        if (rc < 0)
+        {
+            qWarning() << "Failed to detach kernel driver" << rc << libusb_error_name(rc);
+            libusb_close(handle);
+            libusb_free_config_descriptor(confDesc);
+            return false;
+        }
+        detached = true;
+    }
+
+    auto claimed = libusb_claim_interface(handle, iface) >= 0;
+
+    // Get the HID Report Descriptor.
+    unsigned char buffer[256];
+    int length = libusb_control_transfer(handle, LIBUSB_ENDPOINT_IN | LIBUSB_RECIPIENT_INTERFACE,
+        LIBUSB_REQUEST_GET_DESCRIPTOR, LIBUSB_DT_REPORT << 8, iface, buffer, sizeof(buffer), 1000);
 
-        unsigned char buffer[256];
-        for (int iface = 0; iface < confDesc->bNumInterfaces; ++iface)
+    if (claimed)
+        libusb_release_interface(handle, iface);
+
+    if (detached)
+    {
+        // The hidapi will detach it again when the interface is opened.
+        rc = libusb_attach_kernel_driver(handle, iface);
+        if (rc < 0)
         {
-            bool detached = false;
-            bool match = false;
-
-            rc = libusb_kernel_driver_active(handle, iface);
-            if (rc == 1)
-            {
-                rc = libusb_detach_kernel_driver(handle, iface);
-                if (rc < 0)
-                {
-                    qWarning() << "Failed to detach kernel driver" << rc << libusb_error_name(rc);
-                    continue;
-                }
-                detached = true;
-            }
-
-            auto claimed = libusb_claim_interface(handle, iface) >= 0;
-
-            // Get the HID Report Descriptor.
-            rc = libusb_control_transfer(handle, LIBUSB_ENDPOINT_IN | LIBUSB_RECIPIENT_INTERFACE,
-                LIBUSB_REQUEST_GET_DESCRIPTOR, LIBUSB_DT_REPORT << 8, iface, buffer, sizeof(buffer), 1000);
-
-            if (rc < 0)
-            {
-                qWarning() << "Failed to read HID report descriptor" << rc << libusb_error_name(rc);
-            }
-            else
-            {
-                match = findUsage(usagePage, usage, buffer, rc);
-            }
-
-            if (claimed)
-                libusb_release_interface(handle, iface);
-
-            if (match)
-            {
-                *interfaceNumber = iface;
-                auto interface = confDesc->interface[iface];
-
-                for (int ifIdx = 0; ifIdx < interface.num_altsetting; ++ifIdx)
-                {
-                    auto intfDesc = interface.altsetting[ifIdx];
-
-                    for (int epIdx = 0; epIdx < intfDesc.bNumEndpoints; ++epIdx)
-                    {
-                        auto ep = intfDesc.endpoint[epIdx];
-
-                        if ((ep.bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN)
-                            *inBufferLength = ep.wMaxPacketSize;
-                        else if ((ep.bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT)
-                            *outBufferLength = ep.wMaxPacketSize;
-                    }
-                }
-
-                // Note that the kernel driver is still detached.
-                break;
-            }
-            else if (detached)
-            {
-                // Re-attach kernel driver for non-mached devices.
-                rc = libusb_attach_kernel_driver(handle, iface);
-                if (rc < 0)
-                {
-                    qWarning() << "Failed to re-attach kernel driver" << rc << libusb_error_name(rc);
-                }
-            }
+            qWarning() << "Failed to re-attach kernel driver" << rc << libusb_error_name(rc);
         }
+    }
 
-        libusb_close(handle);
+    libusb_close(handle);
+
+    if (length < 0)
+    {
+        qWarning() << "Failed to read HID report descriptor" << length << libusb_error_name(length);
         libusb_free_config_descriptor(confDesc);
-        break;
+        return false;
     }
 
-    libusb_free_device_list(devs, 1);
-    libusb_exit(ctx);
+    info->reportDescriptor = QByteArray((const char *)buffer, length);
+    info->inBufferLength = -1;
+    info->outBufferLength = -1;
+    auto interface = confDesc->interface[iface];
+
+    for (int ifIdx = 0; ifIdx < interface.num_altsetting; ++ifIdx)
+    {
+        auto intfDesc = interface.altsetting[ifIdx];
+
+        for (int epIdx = 0; epIdx < intfDesc.bNumEndpoints; ++epIdx)
+        {
+            auto ep = intfDesc.endpoint[epIdx];
+
+            if ((ep.bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN)
+                info->inBufferLength = ep.wMaxPacketSize;
+            else if ((ep.bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT)
+                info->outBufferLength = ep.wMaxPacketSize;
+        }
+    }
+
+    libusb_free_config_descriptor(confDesc);
+    return true;
 }
 
-static void resetDevice(int vendorId, int deviceId)
+// The usage check for the hidapi flavours which do not report it, and the buffer lengths.
+static bool hidapiMissingFeatures(int vendorId, int deviceId, int usagePage, int usage, const QString &physicalPath,
+    int iface, int *inBufferLength, int *outBufferLength)
 {
-    libusb_context *ctx = nullptr;
-    int rc = libusb_init(&ctx);
-    if (LIBUSB_SUCCESS != rc)
+    QMutexLocker lock(&descriptorCacheMutex);
+    auto key = QString("%1:%2@%3/%4").arg(vendorId, 4, 16, QChar('0')).arg(deviceId, 4, 16, QChar('0'))
+        .arg(physicalPath).arg(iface);
+    auto iter = descriptorCache.constFind(key);
+
+    if (iter == descriptorCache.constEnd())
     {
-        qWarning() << "libusb_init failed" << rc << libusb_error_name(rc);
+        InterfaceInfo info;
+        auto dev = findDevice(vendorId, deviceId, physicalPath);
+        auto ok = dev && readInterface(dev, iface, &info);
+
+        if (dev)
+            libusb_unref_device(dev);
+
+        if (!ok)
+        {
+            // Probably no access rights, try again next time.
+            return false;
+        }
+
+        iter = descriptorCache.insert(key, info);
+    }
+
+    if (iter->inBufferLength > 0)
+        *inBufferLength = iter->inBufferLength;
+    if (iter->outBufferLength > 0)
+        *outBufferLength = iter->outBufferLength;
+
+    return qhidFindUsage(usagePage, usage, (const uint8_t *)iter->reportDescriptor.constData(),
+        size_t(iter->reportDescriptor.size()));
+}
+
+// 1 if a kernel driver is bound to the interface, 0 if not, a LIBUSB_ERROR otherwise.
+static int kernelDriverActive(libusb_device *dev, int iface)
+{
+    libusb_device_handle *handle;
+    int rc = libusb_open(dev, &handle);
+    if (rc < 0)
+        return rc;
+
+    rc = libusb_kernel_driver_active(handle, iface);
+    libusb_close(handle);
+    return rc;
+}
+
+static void reattachKernelDriver(libusb_device *dev, int iface)
+{
+    libusb_device_handle *handle;
+    if (libusb_open(dev, &handle) < 0)
         return;
+
+    // Someone else may have re-attached it already.
+    if (libusb_kernel_driver_active(handle, iface) == 0)
+    {
+        int rc = libusb_attach_kernel_driver(handle, iface);
+        if (rc < 0)
+        {
+            qWarning() << "Failed to re-attach kernel driver" << rc << libusb_error_name(rc);
+        }
     }
 
-    libusb_device **devs;
-    auto count = libusb_get_device_list(ctx, &devs);
+    libusb_close(handle);
+}
+#endif
 
-    for (ssize_t i = 0; i < count; ++i)
+// Where an interface was found the last time, keyed by the ids, the usage and
+// the requested path, so reopening it skips the enumeration.
+struct OpenedInterface
+{
+    // What hid_open_path() takes,
+    QByteArray path;
+    // and what it must still lead to, see interfaceLocation().
+    QString location;
+    QString physicalPath;
+    int interfaceNumber;
+    int inBufferLength;
+    int outBufferLength;
+#ifdef WITH_LIBUSB_1_0
+    // Referenced while in the cache.
+    libusb_device *usbDevice;
+#endif
+};
+
+static QHash<QString, OpenedInterface> interfaceCache;
+static QMutex interfaceCacheMutex;
+
+// The interface behind a hidapi path, found without enumerating; empty if unknown. The hidraw
+// nodes are reused after unplugging, so for them that is the interface directory in the sysfs.
+static QString interfaceLocation(const char *path, int vendorId, int deviceId)
+{
+    auto str = QString::fromLocal8Bit(path);
+
+    if (str.startsWith("/dev/hidraw"))
     {
-        auto dev = devs[i];
-        libusb_device_descriptor desc;
+        // /sys/devices/.../usb1/1-2/1-2:1.0/0003:04D9:A131.0001 => /sys/devices/.../usb1/1-2/1-2:1.0
+        QDir dir(QFileInfo(QString("/sys/class/hidraw/%1/device").arg(str.mid(5))).canonicalFilePath());
+        return dir.cdUp() ? dir.path() : QString();
+    }
 
-        if (libusb_get_device_descriptor(dev, &desc) < 0)
-            continue;
+    QRegExp libusbPath("([0-9a-f]{4}:[0-9a-f]{4}):([0-9a-f]{2})");
+    if (libusbPath.exactMatch(str))
+    {
+#ifdef WITH_LIBUSB_1_0
+        // So are the addresses: 0001:0005:00 => 1-2:00, the port of whatever has the address now.
+        auto usbDevice = findDevice(vendorId, deviceId, libusbPath.cap(1));
+        if (!usbDevice)
+            return QString();
+
+        auto location = usbPortPath(usbDevice).append(':').append(libusbPath.cap(2));
+        libusb_unref_device(usbDevice);
+        return location;
+#else
+        // Nothing tells a replugged device apart.
+        Q_UNUSED(vendorId);
+        Q_UNUSED(deviceId);
+        return QString();
+#endif
+    }
 
-        if (desc.idVendor != vendorId || desc.idProduct != deviceId)
-            continue;
+    return str;
+}
 
-        libusb_device_handle *handle;
-        if (libusb_open(dev, &handle) >= 0)
+// The physical device the interface belongs to: "1-2.3" for the hidraw flavour and
+// the libusb one (or "0001:0005", bus:address, without the libusb), the serial number elsewhere.
+static QString physicalPath(const hid_device_info *dev)
+{
+    auto path = QString::fromLocal8Bit(dev->path);
+
+    if (path.startsWith("/dev/hidraw"))
+    {
+        // /sys/devices/.../usb1/1-2/1-2:1.0/0003:04D9:A131.0001 => 1-2
+        QDir dir(QFileInfo(QString("/sys/class/hidraw/%1/device").arg(path.mid(5))).canonicalFilePath());
+        return dir.cdUp() && dir.cdUp() ? dir.dirName() : path;
+    }
+
+    QRegExp libusbPath("([0-9a-f]{4}:[0-9a-f]{4}):[0-9a-f]{2}");
+    if (libusbPath.exactMatch(path))
+    {
+#ifdef WITH_LIBUSB_1_0
+        // The address changes on every plug, the port path does not.
+        auto usbDevice = findDevice(dev->vendor_id, dev->product_id, libusbPath.cap(1));
+        if (usbDevice)
         {
-            libusb_reset_device(handle);
-            libusb_close(handle);
+            path = usbPortPath(usbDevice);
+            libusb_unref_device(usbDevice);
+            return path;
         }
-        break;
+#endif
+        return libusbPath.cap(1);
     }
 
-    libusb_free_device_list(devs, 1);
-    libusb_exit(ctx);
+    if (dev->serial_number && *dev->serial_number)
+    {
+        return QString::fromWCharArray(dev->serial_number);
+    }
+
+    return path;
 }
-#endif
 
 static int hidapiUsed = 0;
 
-QHIDDevicePrivate::QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage)
+QStringList QHIDDevicePrivate::enumerate(int vendorId, int deviceId)
+{
+    QStringList paths;
+    auto devices = hid_enumerate(vendorId, deviceId);
+
+    for (auto dev = devices; dev != nullptr; dev = dev->next)
+    {
+        auto path = physicalPath(dev);
+        if (!paths.contains(path))
+            paths.append(path);
+    }
+
+    hid_free_enumeration(devices);
+    return paths;
+}
+
+bool QHIDDevicePrivate::canEnumerate()
+{
+    return true;
+}
+
+QHIDDevicePrivate::QHIDDevicePrivate(
+    QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage, const QString &path)
     : device(nullptr)
     , vendorId(vendorId)
     , deviceId(deviceId)
+    , usbDevice(nullptr)
+    , detachedInterface(-1)
     , q_ptr(q_ptr)
 {
     // Make sure we call hid_init() only once.
@@ -259,27 +418,61 @@ QHIDDevicePrivate::QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int device
     // Increment hidapi library usage counter.
     ++hidapiUsed;
 
-    int interfaceNumber = -1;
+    auto key = QString("%1:%2:%3:%4@%5").arg(vendorId).arg(deviceId).arg(usagePage).arg(usage).arg(path);
+    QMutexLocker lock(&interfaceCacheMutex);
+
+    auto iter = interfaceCache.constFind(key);
+    if (iter != interfaceCache.constEnd())
+    {
+        // The same interface as the last time, unless it was unplugged meanwhile.
+        auto location = interfaceLocation(iter->path.constData(), vendorId, deviceId);
+        if (!location.isEmpty() && location == iter->location && open(*iter))
+            return;
+
 #ifdef WITH_LIBUSB_1_0
-    hidapiMissingFeatures(
-        vendorId, deviceId, usagePage, usage, &interfaceNumber, &q_ptr->inputBufferLength, &q_ptr->outputBufferLength);
+        if (iter->usbDevice)
+            libusb_unref_device(iter->usbDevice);
 #endif
+        interfaceCache.remove(key);
+    }
+
     auto devices = hid_enumerate(vendorId, deviceId);
 
     for (auto dev = devices; dev != nullptr; dev = dev->next)
     {
-        if ((dev->usage_page > 0 && dev->usage_page == usagePage && dev->usage == usage)
-            || (dev->interface_number >= 0 && dev->interface_number == interfaceNumber))
-        {
-            device = hid_open_path(dev->path);
+        OpenedInterface info = {dev->path, interfaceLocation(dev->path, vendorId, deviceId), physicalPath(dev),
+            dev->interface_number, q_ptr->inputBufferLength, q_ptr->outputBufferLength};
 
-            if (device != nullptr)
-            {
-                break;
-            }
+        if (!path.isEmpty() && info.physicalPath != path)
+            continue;
 
-            qWarning() << "Failed to open" << dev->path << "error" << errno;
+        auto matched = dev->usage_page > 0 && dev->usage_page == usagePage && dev->usage == usage;
+#ifdef WITH_LIBUSB_1_0
+        // No need to bother the interfaces which report another usage.
+        if (dev->interface_number >= 0 && (matched || dev->usage_page <= 0))
+        {
+            matched = hidapiMissingFeatures(vendorId, deviceId, usagePage, usage, info.physicalPath,
+                          dev->interface_number, &info.inBufferLength, &info.outBufferLength)
+                || matched;
+        }
+#endif
+        if (!matched)
+            continue;
+
+#ifdef WITH_LIBUSB_1_0
+        info.usbDevice = findDevice(vendorId, deviceId, info.physicalPath);
+#endif
+        if (open(info))
+        {
+            interfaceCache.insert(key, info);
+            break;
         }
+
+        qWarning() << "Failed to open" << dev->path << "error" << errno;
+#ifdef WITH_LIBUSB_1_0
+        if (info.usbDevice)
+            libusb_unref_device(info.usbDevice);
+#endif
     }
 
     hid_free_enumeration(devices);
@@ -290,6 +483,32 @@ QHIDDevicePrivate::QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int device
     }
 }
 
+bool QHIDDevicePrivate::open(const OpenedInterface &info)
+{
+#ifdef WITH_LIBUSB_1_0
+    auto wasActive = info.usbDevice && kernelDriverActive(info.usbDevice, info.interfaceNumber) == 1;
+#endif
+    device = hid_open_path(info.path.constData());
+    if (device == nullptr)
+        return false;
+
+    q_ptr->inputBufferLength = info.inBufferLength;
+    q_ptr->outputBufferLength = info.outBufferLength;
+    openedPath = info.physicalPath;
+
+#ifdef WITH_LIBUSB_1_0
+    // The libusb flavour of the hidapi detaches the kernel driver on open,
+    // the hidraw one works through it. Re-attach only what was really taken.
+    if (wasActive && kernelDriverActive(info.usbDevice, info.interfaceNumber) == 0)
+    {
+        usbDevice = libusb_ref_device(info.usbDevice);
+        detachedInterface = info.interfaceNumber;
+    }
+#endif
+
+    return true;
+}
+
 QHIDDevicePrivate::~QHIDDevicePrivate()
 {
     if (device)
@@ -298,10 +517,16 @@ QHIDDevicePrivate::~QHIDDevicePrivate()
         device = nullptr;
 
 #ifdef WITH_LIBUSB_1_0
-        // Until reset the keyboard interface will be ignored by the kernel
-        // since the hidapi library does detach the kernel driver and does
-        // not re-attach it back.
-        resetDevice(vendorId, deviceId);
+        // The keyboard interface will be ignored by the kernel since
+        // the hidapi library does detach the kernel driver and does
+        // not re-attach it back. Re-attach just that interface,
+        // resetting the whole device makes the keyboard drop keystrokes.
+        if (usbDevice)
+        {
+            reattachKernelDriver(usbDevice, detachedInterface);
+            libusb_unref_device(usbDevice);
+            usbDevice = nullptr;
+        }
 #endif
     }
 
@@ -312,6 +537,11 @@ QHIDDevicePrivate::~QHIDDevicePrivate()
     }
 }
 
+QString QHIDDevicePrivate::path() const
+{
+    return openedPath;
+}
+
 bool QHIDDevicePrivate::isValid() const
 {
     return !!device;
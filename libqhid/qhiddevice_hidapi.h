@@ -19,31 +19,45 @@
 #ifndef QHIDDEVICE_HIDAPI_H
 #define QHIDDEVICE_HIDAPI_H
 
+#include "qhidtransport.h"
+
 #include <QObject>
+#include <QStringList>
 #include <hidapi.h>
 
 class QHIDDevice;
-class QHIDDevicePrivate : public QObject
+struct OpenedInterface;
+class QHIDDevicePrivate : public QObject, public QHIDTransport
 {
     Q_OBJECT
     Q_DECLARE_PUBLIC(QHIDDevice)
 
 public:
-    QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage);
+    QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage, const QString &path);
     ~QHIDDevicePrivate();
 
-    bool isValid() const;
+    static QStringList enumerate(int vendorId, int deviceId);
+    static bool canEnumerate();
+    QString path() const;
+
+    bool isValid() const override;
 
-    int sendFeatureReport(const char *buffer, int length);
-    int getFeatureReport(char *buffer, int length);
+    int sendFeatureReport(const char *buffer, int length) override;
+    int getFeatureReport(char *buffer, int length) override;
 
-    int write(const char *buffer, int length);
-    int read(char *buffer, int length, int timeout);
+    int write(const char *buffer, int length) override;
+    int read(char *buffer, int length, int timeout) override;
 
 private:
+    bool open(const OpenedInterface &info);
+
     hid_device *device;
     int vendorId;
     int deviceId;
+    QString openedPath;
+    // The interface with the kernel driver detached, to re-attach on close.
+    struct libusb_device *usbDevice;
+    int detachedInterface;
     QHIDDevice *q_ptr;
 };
 
@@ -0,0 +1,216 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "qhiddevice.h"
+#include "qhiddevice_hidraw.h"
+#include "qhidreportdescriptor.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/hidraw.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#define SYSFS_HIDRAW "/sys/class/hidraw"
+
+static QByteArray readAttribute(const QString &path)
+{
+    QFile file(path);
+    return file.open(QFile::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+static bool matchIds(const QString &devicePath, int vendorId, int deviceId)
+{
+    // HID_ID=0003:000004D9:0000A131
+    foreach (auto line, readAttribute(devicePath + "/uevent").split('\n'))
+    {
+        if (!line.startsWith("HID_ID="))
+            continue;
+
+        auto ids = line.mid(7).split(':');
+        return ids.size() == 3 && strtol(ids[1], nullptr, 16) == vendorId && strtol(ids[2], nullptr, 16) == deviceId;
+    }
+
+    return false;
+}
+
+static void endpointSizes(const QString &devicePath, int *inBufferLength, int *outBufferLength)
+{
+    // The parent of the HID device is the USB interface with the endpoint descriptors.
+    QDir usbInterface(devicePath + "/..");
+
+    foreach (auto ep, usbInterface.entryList(QStringList("ep_*"), QDir::Dirs))
+    {
+        auto address = strtol(readAttribute(usbInterface.filePath(ep + "/bEndpointAddress")).trimmed(), nullptr, 16);
+        auto size = strtol(readAttribute(usbInterface.filePath(ep + "/wMaxPacketSize")).trimmed(), nullptr, 16);
+
+        if (size <= 0)
+            continue;
+
+        if (address & 0x80)
+            *inBufferLength = int(size);
+        else
+            *outBufferLength = int(size);
+    }
+}
+
+static QString usbDevicePath(const QString &devicePath)
+{
+    // /sys/devices/.../usb1/1-2/1-2:1.0/0003:04D9:A131.0001 => 1-2
+    QDir dir(QFileInfo(devicePath).canonicalFilePath());
+    return dir.cdUp() && dir.cdUp() ? dir.dirName() : QString();
+}
+
+QStringList QHIDDevicePrivate::enumerate(int vendorId, int deviceId)
+{
+    QStringList paths;
+    QDir sysfs(SYSFS_HIDRAW);
+
+    foreach (auto name, sysfs.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        auto devicePath = sysfs.filePath(name + "/device");
+
+        if (matchIds(devicePath, vendorId, deviceId))
+        {
+            auto path = usbDevicePath(devicePath);
+            if (!path.isEmpty() && !paths.contains(path))
+                paths.append(path);
+        }
+    }
+
+    return paths;
+}
+
+bool QHIDDevicePrivate::canEnumerate()
+{
+    return true;
+}
+
+QHIDDevicePrivate::QHIDDevicePrivate(
+    QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage, const QString &path)
+    : fd(-1)
+    , q_ptr(q_ptr)
+{
+    QDir sysfs(SYSFS_HIDRAW);
+
+    foreach (auto name, sysfs.entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+    {
+        auto devicePath = sysfs.filePath(name + "/device");
+
+        if (!matchIds(devicePath, vendorId, deviceId))
+            continue;
+
+        if (!path.isEmpty() && usbDevicePath(devicePath) != path)
+            continue;
+
+        // Unlike the ioctl, the sysfs attribute is readable without access to the device node.
+        auto desc = readAttribute(devicePath + "/report_descriptor");
+        if (!qhidFindUsage(usagePage, usage, (const uint8_t *)desc.constData(), size_t(desc.size())))
+            continue;
+
+        auto node = QString("/dev/%1").arg(name);
+        fd = ::open(node.toLocal8Bit(), O_RDWR | O_CLOEXEC);
+
+        if (fd < 0)
+        {
+            qWarning() << "Failed to open" << node << "error" << errno;
+            continue;
+        }
+
+        endpointSizes(devicePath, &q_ptr->inputBufferLength, &q_ptr->outputBufferLength);
+        openedPath = usbDevicePath(devicePath);
+        break;
+    }
+
+    if (fd < 0)
+    {
+        qWarning() << "No such device" << vendorId << deviceId << usagePage;
+    }
+}
+
+QHIDDevicePrivate::~QHIDDevicePrivate()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+QString QHIDDevicePrivate::path() const
+{
+    return openedPath;
+}
+
+bool QHIDDevicePrivate::isValid() const
+{
+    return fd >= 0;
+}
+
+int QHIDDevicePrivate::handle() const
+{
+    return fd;
+}
+
+int QHIDDevicePrivate::sendFeatureReport(const char *buffer, int length)
+{
+    return fd < 0 ? -1 : ioctl(fd, HIDIOCSFEATURE(length), buffer);
+}
+
+int QHIDDevicePrivate::getFeatureReport(char *buffer, int length)
+{
+    // The first byte is the report number, the kernel returns it back.
+    return fd < 0 ? -1 : ioctl(fd, HIDIOCGFEATURE(length), buffer);
+}
+
+int QHIDDevicePrivate::write(const char *buffer, int length)
+{
+    return fd < 0 ? -1 : int(::write(fd, buffer, size_t(length)));
+}
+
+int QHIDDevicePrivate::read(char *buffer, int length, int timeout)
+{
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    pollfd pfd = {fd, POLLIN, 0};
+    int ret = poll(&pfd, 1, timeout);
+
+    if (ret <= 0)
+    {
+        // Timed out (0) or failed (-1), as hidapi does.
+        return ret < 0 && errno == EINTR ? 0 : ret;
+    }
+
+    if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+    {
+        // The device was unplugged.
+        return -1;
+    }
+
+    ret = int(::read(fd, buffer, size_t(length)));
+    return ret < 0 && (errno == EAGAIN || errno == EINPROGRESS) ? 0 : ret;
+}
@@ -0,0 +1,58 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef QHIDDEVICE_HIDRAW_H
+#define QHIDDEVICE_HIDRAW_H
+
+#include "qhidtransport.h"
+
+#include <QObject>
+#include <QStringList>
+
+class QHIDDevice;
+class QHIDDevicePrivate : public QObject, public QHIDTransport
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(QHIDDevice)
+
+public:
+    QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage, const QString &path);
+    ~QHIDDevicePrivate();
+
+    static QStringList enumerate(int vendorId, int deviceId);
+    static bool canEnumerate();
+    QString path() const;
+
+    bool isValid() const override;
+
+    int sendFeatureReport(const char *buffer, int length) override;
+    int getFeatureReport(char *buffer, int length) override;
+
+    int write(const char *buffer, int length) override;
+    int read(char *buffer, int length, int timeout) override;
+
+    // The /dev/hidrawN descriptor, e.g. for a QSocketNotifier.
+    int handle() const override;
+
+private:
+    int fd;
+    QString openedPath;
+    QHIDDevice *q_ptr;
+};
+
+#endif // QHIDDEVICE_HIDRAW_H
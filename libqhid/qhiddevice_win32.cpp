@@ -26,7 +26,20 @@ extern "C" {
 #include <Hidsdi.h>
 }
 
-QHIDDevicePrivate::QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage)
+QStringList QHIDDevicePrivate::enumerate(int, int)
+{
+    // Each interface is a separate device here, grouping them needs the cfgmgr32.
+    // A part of the device path can still be passed to the constructor.
+    return QStringList();
+}
+
+bool QHIDDevicePrivate::canEnumerate()
+{
+    return false;
+}
+
+QHIDDevicePrivate::QHIDDevicePrivate(
+    QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage, const QString &path)
     : hDevice(INVALID_HANDLE_VALUE)
     , q_ptr(q_ptr)
 {
@@ -86,7 +99,7 @@ QHIDDevicePrivate::QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int device
                 }
             }
 
-            if (vid == vendorId && pid == deviceId)
+            if (vid == vendorId && pid == deviceId && (path.isEmpty() || name.contains(path, Qt::CaseInsensitive)))
             {
                 hDevice = CreateFile(pdidd->DevicePath, GENERIC_WRITE | GENERIC_READ,
                     FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
@@ -113,6 +126,8 @@ QHIDDevicePrivate::QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int device
                         // For Windows it's wMaxPacketSize + 1 (report byte), so we decrement.
                         q_ptr->inputBufferLength = caps.InputReportByteLength;
                         q_ptr->outputBufferLength = caps.OutputReportByteLength;
+                        readBuffer.resize(caps.InputReportByteLength);
+                        writeBuffer.resize(caps.OutputReportByteLength);
 
                         overlapped.hEvent = CreateEvent(nullptr, false, false, nullptr);
                     }
@@ -155,6 +170,12 @@ QHIDDevicePrivate::~QHIDDevicePrivate()
     }
 }
 
+QString QHIDDevicePrivate::path() const
+{
+    // Every interface has its own name, none of them identifies the device.
+    return QString();
+}
+
 bool QHIDDevicePrivate::isValid() const
 {
     return hDevice != INVALID_HANDLE_VALUE;
@@ -187,9 +208,10 @@ int QHIDDevicePrivate::write(const char *buffer, int length)
         // Windows expects the number of bytes which are in the _longest_ report
         // (plus one for the report number) bytes even if the data is a report
         // which is shorter than that.
-        QByteArray tmp(buffer, length);
-        tmp.resize(q->outputBufferLength);
-        ret = WriteFile(hDevice, tmp.cbegin(), tmp.length(), &written, &overlapped);
+        auto tmp = writeBuffer.data();
+        memcpy(tmp, buffer, size_t(length));
+        memset(tmp + length, 0, size_t(writeBuffer.length() - length));
+        ret = WriteFile(hDevice, tmp, writeBuffer.length(), &written, &overlapped);
     }
     else
     {
@@ -211,24 +233,24 @@ int QHIDDevicePrivate::write(const char *buffer, int length)
     return -1;
 }
 
-int QHIDDevicePrivate::read(char *buffer, int length, unsigned int timeout)
+int QHIDDevicePrivate::read(char *buffer, int length, int timeout)
 {
-    Q_Q(QHIDDevice);
     DWORD read = 0;
-    QByteArray tmp(q->inputBufferLength, Qt::Uninitialized);
+    auto &tmp = readBuffer;
 
     ResetEvent(overlapped.hEvent);
     auto ret = ReadFile(hDevice, tmp.begin(), tmp.length(), &read, &overlapped);
-    if (!ret)
+    if (!ret && GetLastError() == ERROR_IO_PENDING)
     {
-        if (GetLastError() == ERROR_IO_PENDING && timeout)
+        // Nothing to read in time is not an error, as with hidapi.
+        auto wait = WaitForSingleObject(overlapped.hEvent, timeout < 0 ? INFINITE : DWORD(timeout));
+        if (wait == WAIT_TIMEOUT)
         {
-            ret = WaitForSingleObject(overlapped.hEvent, timeout);
-            if (ret == WAIT_OBJECT_0)
-            {
-                ret = GetOverlappedResult(hDevice, &overlapped, &read, true);
-            }
+            CancelIo(hDevice);
+            return 0;
         }
+
+        ret = wait == WAIT_OBJECT_0 && GetOverlappedResult(hDevice, &overlapped, &read, true);
     }
 
     if (ret && (int)read == tmp.length())
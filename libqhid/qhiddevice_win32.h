@@ -19,31 +19,42 @@
 #ifndef QHIDDEVICE_WIN32_H
 #define QHIDDEVICE_WIN32_H
 
+#include "qhidtransport.h"
+
+#include <QByteArray>
 #include <QObject>
+#include <QStringList>
 #include <qt_windows.h>
 
 class QHIDDevice;
-class QHIDDevicePrivate : public QObject
+class QHIDDevicePrivate : public QObject, public QHIDTransport
 {
     Q_OBJECT
     Q_DECLARE_PUBLIC(QHIDDevice)
 
 public:
-    QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage);
+    QHIDDevicePrivate(QHIDDevice *q_ptr, int vendorId, int deviceId, int usagePage, int usage, const QString &path);
     ~QHIDDevicePrivate();
 
-    bool isValid() const;
+    static QStringList enumerate(int vendorId, int deviceId);
+    static bool canEnumerate();
+    QString path() const;
+
+    bool isValid() const override;
 
-    int sendFeatureReport(const char *buffer, int length);
-    int getFeatureReport(char *buffer, int length);
+    int sendFeatureReport(const char *buffer, int length) override;
+    int getFeatureReport(char *buffer, int length) override;
 
-    int write(const char *buffer, int length);
-    int read(char *buffer, int length, unsigned int timeout);
+    int write(const char *buffer, int length) override;
+    int read(char *buffer, int length, int timeout) override;
 
 private:
     HANDLE hDevice;
     OVERLAPPED overlapped;
     QHIDDevice *q_ptr;
+    // Full size reports, allocated once.
+    QByteArray readBuffer;
+    QByteArray writeBuffer;
 };
 
 #endif // QHIDDEVICE_WIN32_H
@@ -25,9 +25,9 @@
 #include "qhidmonitor_win32.h"
 #endif
 
-QHIDMonitor::QHIDMonitor(int vendorId, int deviceId, QObject *parent)
+QHIDMonitor::QHIDMonitor(int vendorId, int deviceId, const QString &tag, QObject *parent)
     : QObject(parent)
-    , d_ptr(new QHIDMonitorPrivate(this, vendorId, deviceId))
+    , d_ptr(new QHIDMonitorPrivate(this, vendorId, deviceId, tag))
 {
 }
 
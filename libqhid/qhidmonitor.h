@@ -28,12 +28,15 @@ class QHIDMonitor : public QObject
     Q_DECLARE_PRIVATE(QHIDMonitor)
 
 public:
-    QHIDMonitor(int vendorId, int deviceId, QObject *parent = 0);
+    // The tag is the one the udev rules give the device, if any. The events of
+    // the other devices are dropped by the kernel then, not by us.
+    QHIDMonitor(int vendorId, int deviceId, const QString &tag = QString(), QObject *parent = 0);
     ~QHIDMonitor();
 
 signals:
+    // The path is the one QHIDDevice::enumerate() lists, the device name on Windows.
     void deviceArrival(const QString& path);
-    void deviceRemove();
+    void deviceRemove(const QString& path);
 
 protected:
     class QHIDMonitorPrivate *d_ptr;
@@ -20,34 +20,41 @@
 #include "qhidmonitor_libusb.h"
 
 #include <QDebug>
+#include <QSocketNotifier>
+
+#ifndef Q_OS_WIN32
+#include <poll.h>
+#endif
 
 int LIBUSB_CALL QHIDMonitorPrivate::callback(
     libusb_context *, libusb_device *device, libusb_hotplug_event event, void *userData)
 {
     auto q = reinterpret_cast<QHIDMonitorPrivate *>(userData)->q_func();
 
+    // 1-2.3, as the kernel names it
+    uint8_t ports[16];
+    auto str = QString::number(libusb_get_bus_number(device));
+    int count = libusb_get_port_numbers(device, ports, sizeof(ports));
+    for (int i = 0; i < count; ++i)
+    {
+        str.append(i == 0 ? '-' : '.').append(QString::number(ports[i]));
+    }
+
     if (LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED == event)
     {
-        QString str;
-        QByteArray path(16, 0);
-        int pathLen = libusb_get_port_numbers(device, (uint8_t *)path.data(), path.length());
-        for (int i = 0; i < pathLen; ++i)
-        {
-            str.append(QString::number(path.at(i))).append(":");
-        }
-        str.append(QString::number(libusb_get_device_address(device)));
         emit(q->deviceArrival(str));
     }
     else
     {
-        emit(q->deviceRemove());
+        emit(q->deviceRemove(str));
     }
 
     return 0;
 }
 
-QHIDMonitorPrivate::QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId)
+QHIDMonitorPrivate::QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId, const QString &)
     : timerId(0)
+    , ctx(nullptr)
     , handle(0)
     , q_ptr(q_ptr)
 {
@@ -67,8 +74,9 @@ QHIDMonitorPrivate::QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int dev
     {
         qWarning() << "Error creating a hotplug callback" << libusb_error_name(rc);
     }
-    else
+    else if (!watchPollfds())
     {
+        // No file descriptors to watch (e.g. Windows), poll instead.
         timerId = startTimer(1000);
     }
 }
@@ -83,6 +91,12 @@ QHIDMonitorPrivate::~QHIDMonitorPrivate()
 
     if (ctx)
     {
+        libusb_set_pollfd_notifiers(ctx, nullptr, nullptr, nullptr);
+        qDeleteAll(readNotifiers);
+        qDeleteAll(writeNotifiers);
+        readNotifiers.clear();
+        writeNotifiers.clear();
+
         if (handle)
         {
             libusb_hotplug_deregister_callback(ctx, handle);
@@ -100,3 +114,87 @@ void QHIDMonitorPrivate::timerEvent(QTimerEvent *evt)
     timeval tv = {0, 10000};
     libusb_handle_events_timeout(ctx, &tv);
 }
+
+void QHIDMonitorPrivate::handleEvents()
+{
+    // Something is pending, so there is no need to wait.
+    timeval tv = {0, 0};
+    libusb_handle_events_timeout(ctx, &tv);
+}
+
+void LIBUSB_CALL QHIDMonitorPrivate::pollfdAdded(int fd, short events, void *userData)
+{
+    reinterpret_cast<QHIDMonitorPrivate *>(userData)->addPollfd(fd, events);
+}
+
+void LIBUSB_CALL QHIDMonitorPrivate::pollfdRemoved(int fd, void *userData)
+{
+    reinterpret_cast<QHIDMonitorPrivate *>(userData)->removePollfd(fd);
+}
+
+bool QHIDMonitorPrivate::watchPollfds()
+{
+#ifdef Q_OS_WIN32
+    return false;
+#else
+    // The internal timers must be reported through a file descriptor too,
+    // otherwise libusb expects to be called periodically.
+    if (!libusb_pollfds_handle_timeouts(ctx))
+        return false;
+
+    auto pollfds = libusb_get_pollfds(ctx);
+    if (!pollfds)
+        return false;
+
+    for (auto pfd = pollfds; *pfd; ++pfd)
+    {
+        addPollfd((*pfd)->fd, (*pfd)->events);
+    }
+
+    libusb_free_pollfds(pollfds);
+    libusb_set_pollfd_notifiers(ctx, QHIDMonitorPrivate::pollfdAdded, QHIDMonitorPrivate::pollfdRemoved, this);
+    return true;
+#endif
+}
+
+void QHIDMonitorPrivate::addPollfd(int fd, short events)
+{
+#ifndef Q_OS_WIN32
+    removePollfd(fd);
+
+    if (events & POLLIN)
+    {
+        auto notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(notifier, SIGNAL(activated(int)), this, SLOT(handleEvents()));
+        readNotifiers.insert(fd, notifier);
+    }
+
+    if (events & POLLOUT)
+    {
+        auto notifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+        connect(notifier, SIGNAL(activated(int)), this, SLOT(handleEvents()));
+        writeNotifiers.insert(fd, notifier);
+    }
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(events);
+#endif
+}
+
+void QHIDMonitorPrivate::removePollfd(int fd)
+{
+    // Called from the handleEvents, so the notifier must not be deleted right away.
+    auto notifier = readNotifiers.take(fd);
+    if (notifier)
+    {
+        notifier->setEnabled(false);
+        notifier->deleteLater();
+    }
+
+    notifier = writeNotifiers.take(fd);
+    if (notifier)
+    {
+        notifier->setEnabled(false);
+        notifier->deleteLater();
+    }
+}
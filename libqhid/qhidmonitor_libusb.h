@@ -19,9 +19,12 @@
 #ifndef QHIDMONITOR_LIBUSB_H
 #define QHIDMONITOR_LIBUSB_H
 
+#include <QHash>
 #include <QObject>
 #include <libusb.h>
 
+class QSocketNotifier;
+
 class QHIDMonitor;
 class QHIDMonitorPrivate : public QObject
 {
@@ -29,16 +32,27 @@ class QHIDMonitorPrivate : public QObject
     Q_DECLARE_PUBLIC(QHIDMonitor)
 
 public:
-    QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId);
+    QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId, const QString &tag);
     ~QHIDMonitorPrivate();
 
 protected:
     virtual void timerEvent(QTimerEvent *evt);
 
+private slots:
+    void handleEvents();
+
 private:
     static int LIBUSB_CALL callback(libusb_context *, libusb_device *device, libusb_hotplug_event event, void *userData);
+    static void LIBUSB_CALL pollfdAdded(int fd, short events, void *userData);
+    static void LIBUSB_CALL pollfdRemoved(int fd, void *userData);
+
+    bool watchPollfds();
+    void addPollfd(int fd, short events);
+    void removePollfd(int fd);
 
     int timerId;
+    QHash<int, QSocketNotifier *> readNotifiers;
+    QHash<int, QSocketNotifier *> writeNotifiers;
     libusb_context *ctx;
     libusb_hotplug_callback_handle handle;
     QHIDMonitor *q_ptr;
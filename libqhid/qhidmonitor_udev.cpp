@@ -20,17 +20,80 @@
 #include "qhidmonitor_udev.h"
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
 #include <QSocketNotifier>
+#include <QTimer>
 
 #include <libudev.h>
 
-QHIDMonitorPrivate::QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId)
+// Time to wait for the device to settle down, in milliseconds.
+#define SETTLE_TIMEOUT 250
+
+// Whether the udev rules give the device the tag. An attached device tells
+// for sure, otherwise the tag is looked for in the rules.
+static bool isTagged(struct udev *udev, int vendorId, int deviceId, const QString &tag)
+{
+    auto enumerate = udev_enumerate_new(udev);
+    udev_enumerate_add_match_subsystem(enumerate, "usb");
+    udev_enumerate_add_match_sysattr(enumerate, "idVendor", qPrintable(QString("%1").arg(vendorId, 4, 16, QChar('0'))));
+    udev_enumerate_add_match_sysattr(enumerate, "idProduct", qPrintable(QString("%1").arg(deviceId, 4, 16, QChar('0'))));
+    udev_enumerate_scan_devices(enumerate);
+
+    int found = -1;
+    auto first = udev_enumerate_get_list_entry(enumerate);
+    auto device = first ? udev_device_new_from_syspath(udev, udev_list_entry_get_name(first)) : nullptr;
+    if (device)
+    {
+        found = 0;
+        for (auto item = udev_device_get_tags_list_entry(device); item; item = udev_list_entry_get_next(item))
+        {
+            if (tag == udev_list_entry_get_name(item))
+                found = 1;
+        }
+        udev_device_unref(device);
+    }
+    udev_enumerate_unref(enumerate);
+
+    if (found >= 0)
+        return found > 0;
+
+    auto rule = QString("TAG+=\"%1\"").arg(tag).toUtf8();
+    foreach (auto dir, QStringList() << "/etc/udev/rules.d" << "/run/udev/rules.d" << "/usr/lib/udev/rules.d"
+                                     << "/lib/udev/rules.d")
+    {
+        foreach (auto info, QDir(dir).entryInfoList(QStringList("*.rules"), QDir::Files))
+        {
+            QFile file(info.filePath());
+            if (file.open(QFile::ReadOnly) && file.readAll().contains(rule))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+QHIDMonitorPrivate::QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId, const QString &tag)
     : vendorId(vendorId)
     , deviceId(deviceId)
+    , settleTimer(new QTimer(this))
     , q_ptr(q_ptr)
 {
-    monitor = udev_monitor_new_from_netlink(udev_new(), "udev");
-    udev_monitor_filter_add_match_subsystem_devtype(monitor, "usb", 0);
+    settleTimer->setSingleShot(true);
+    settleTimer->setInterval(SETTLE_TIMEOUT);
+    connect(settleTimer, SIGNAL(timeout()), this, SLOT(settled()));
+
+    auto udev = udev_new();
+    monitor = udev_monitor_new_from_netlink(udev, "udev");
+    // The filter is a socket filter, so the events of the interfaces, hidraw & input
+    // nodes etc. are dropped by the kernel and never wake us up. It can not match
+    // the vendor & product, but the tag our rules give the device. Without the rules
+    // installed the other USB devices are filtered below.
+    udev_monitor_filter_add_match_subsystem_devtype(monitor, "usb", "usb_device");
+    if (!tag.isEmpty() && isTagged(udev, vendorId, deviceId, tag))
+        udev_monitor_filter_add_match_tag(monitor, qPrintable(tag));
+    else if (!tag.isEmpty())
+        qDebug() << "The udev rules do not tag the device" << tag << "every USB device wakes the monitor";
     udev_monitor_enable_receiving(monitor);
     int fd = udev_monitor_get_fd(monitor);
     monitorNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
@@ -69,16 +132,18 @@ void QHIDMonitorPrivate::udevDataAvailable()
             qDebug() << udev_list_entry_get_name(item) << udev_list_entry_get_value(item);
         }
 #endif
-        Q_Q(QHIDMonitor);
+        // The sysname of a usb_device is its port path, 1-2.3
+        auto path = QString::fromLocal8Bit(udev_device_get_sysname(device));
 
         if (strcasecmp(action, "add") == 0)
         {
-            auto path = udev_device_get_syspath(device);
-            emit(q->deviceArrival(QString::fromLocal8Bit(path)));
+            pending[path] = true;
+            settleTimer->start();
         }
         else if (strcasecmp(action, "remove") == 0)
         {
-            emit(q->deviceRemove());
+            pending[path] = false;
+            settleTimer->start();
         }
         else
         {
@@ -88,3 +153,24 @@ void QHIDMonitorPrivate::udevDataAvailable()
 
     udev_device_unref(device);
 }
+
+void QHIDMonitorPrivate::settled()
+{
+    Q_Q(QHIDMonitor);
+
+    // Only the final state of every device matters, e.g. a quick replug is a single arrival.
+    auto settledDevices = pending;
+    pending.clear();
+
+    for (auto iter = settledDevices.constBegin(); iter != settledDevices.constEnd(); ++iter)
+    {
+        if (iter.value())
+        {
+            emit(q->deviceArrival(iter.key()));
+        }
+        else
+        {
+            emit(q->deviceRemove(iter.key()));
+        }
+    }
+}
@@ -19,6 +19,7 @@
 #ifndef QHIDMONITOR_UDEV_H
 #define QHIDMONITOR_UDEV_H
 
+#include <QHash>
 #include <QObject>
 
 class QHIDMonitor;
@@ -31,15 +32,20 @@ class QHIDMonitorPrivate : public QObject
     Q_DECLARE_PUBLIC(QHIDMonitor)
 
 public:
-    QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId);
+    QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId, const QString &tag);
     ~QHIDMonitorPrivate();
 
 private slots:
     void udevDataAvailable();
+    void settled();
 
 private:
     struct udev_monitor *monitor;
     class QSocketNotifier *monitorNotifier;
+    // Coalesces the burst of events of a single plug/unplug.
+    class QTimer *settleTimer;
+    // The last action of every device (by the port path) since the timer was started, true for the arrival.
+    QHash<QString, bool> pending;
     class QHIDMonitor *q_ptr;
 };
 
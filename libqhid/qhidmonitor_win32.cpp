@@ -73,14 +73,14 @@ LRESULT CALLBACK QHIDMonitorPrivate::wndProc(HWND hwnd, UINT message, WPARAM wPa
         }
         else if (wParam == DBT_DEVICEREMOVECOMPLETE)
         {
-            emit(q->deviceRemove());
+            emit(q->deviceRemove(name));
         }
     }
 
     return DefWindowProc(hwnd, message, wParam, lParam);
 }
 
-QHIDMonitorPrivate::QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId)
+QHIDMonitorPrivate::QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId, const QString &)
     : vendorId(vendorId)
     , deviceId(deviceId)
     , hDevNotify(nullptr)
@@ -31,7 +31,7 @@ class QHIDMonitorPrivate
     Q_DECLARE_PUBLIC(QHIDMonitor)
 
 public:
-    QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId);
+    QHIDMonitorPrivate(QHIDMonitor *q_ptr, int vendorId, int deviceId, const QString &tag);
     ~QHIDMonitorPrivate();
 
 private:
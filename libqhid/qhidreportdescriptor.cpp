@@ -0,0 +1,83 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "qhidreportdescriptor.h"
+
+bool qhidFindUsage(int usagePage, int usage, const uint8_t *desc, size_t size)
+{
+    unsigned int i = 0;
+    int dataLen, keySize;
+    bool usageMatch = false, pageMatch = false;
+
+    while (i < size)
+    {
+        int key = desc[i];
+
+        if ((key & 0xf0) == 0xf0)
+        {
+            /* This is a Long Item. The next byte contains the
+               length of the data section (value) for this key.
+               See the HID specification, version 1.11, section
+               6.2.2.3, titled "Long Items." */
+            dataLen = i + 1 < size ? desc[i + 1] : 0;
+            keySize = 3;
+        }
+        else
+        {
+            /* This is a Short Item. The bottom two bits of the
+               key contain the size code for the data section
+               (value) for this key.  Refer to the HID
+               specification, version 1.11, section 6.2.2.2,
+               titled "Short Items." */
+            dataLen = key & 0x3;
+            if (dataLen == 3)
+                ++dataLen; // 0,1,2,4
+            keySize = 1;
+        }
+
+        auto tag = (key & 0xfc);
+        if (tag == 0x04 || tag == 0x08)
+        {
+            if (i + dataLen >= size)
+            {
+                // Truncated report?
+                return false;
+            }
+
+            int value = 0;
+            for (int offset = dataLen; offset > 0; --offset)
+            {
+                value <<= 8;
+                value |= desc[i + offset];
+            }
+
+            if (tag == 0x04 && value == usagePage)
+                pageMatch = true;
+            else if (tag == 0x08 && value == usage)
+                usageMatch = true;
+
+            if (pageMatch && usageMatch)
+                return true;
+        }
+
+        // Skip over this key and it's associated data.
+        i += dataLen + keySize;
+    }
+
+    return false;
+}
@@ -0,0 +1,224 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "qhidstats.h"
+
+#include <QDebug>
+#include <QtEndian>
+
+static const char *operationNames[] = {
+    "send-feature",
+    "get-feature",
+    "write",
+    "read",
+    "sleep",
+};
+
+static int bucketOf(quint64 usecs)
+{
+    int idx = 0;
+
+    while (usecs > 0 && idx < QHIDStats::BucketCount - 1)
+    {
+        usecs >>= 1;
+        ++idx;
+    }
+
+    return idx;
+}
+
+QHIDStats *QHIDStats::instance()
+{
+    static QHIDStats stats;
+    return &stats;
+}
+
+const char *QHIDStats::operationName(Operation op)
+{
+    return op >= 0 && op < OperationCount ? operationNames[op] : "unknown";
+}
+
+QHIDStats::QHIDStats()
+    : tracing(false)
+    , traceStart(0)
+{
+    clock.start();
+    reset();
+}
+
+QHIDStats::~QHIDStats()
+{
+    stopTrace();
+}
+
+void QHIDStats::record(Operation op, int tag, qint64 nsecs, int result)
+{
+    auto usecs = quint64(qMax(nsecs, qint64(0)) / 1000);
+    auto &h = histograms[op];
+
+    ++h.count;
+    h.total += usecs;
+    ++h.buckets[bucketOf(usecs)];
+    if (result > 0)
+        h.bytes += quint64(result);
+
+    auto max = h.max.load();
+    while (usecs > max && !h.max.compare_exchange_weak(max, usecs))
+    {
+    }
+
+    if (!tracing)
+        return;
+
+    uchar buffer[TraceRecordSize];
+    QMutexLocker lock(&traceMutex);
+
+    if (!trace.isOpen())
+        return;
+
+    qToLittleEndian<quint64>(quint64(qMax(clock.nsecsElapsed() - nsecs - traceStart, qint64(0))), buffer);
+    qToLittleEndian<quint32>(quint32(qMin(usecs, quint64(0xFFFFFFFF))), buffer + 8);
+    buffer[12] = uchar(op);
+    buffer[13] = uchar(tag);
+    qToLittleEndian<qint16>(qint16(qBound(-0x8000, result, 0x7FFF)), buffer + 14);
+    trace.write(reinterpret_cast<const char *>(buffer), TraceRecordSize);
+}
+
+void QHIDStats::reset()
+{
+    for (int op = 0; op < OperationCount; ++op)
+    {
+        auto &h = histograms[op];
+        h.count = 0;
+        h.total = 0;
+        h.max = 0;
+        h.bytes = 0;
+
+        for (int idx = 0; idx < BucketCount; ++idx)
+        {
+            h.buckets[idx] = 0;
+        }
+    }
+}
+
+quint64 QHIDStats::count(Operation op) const
+{
+    return histograms[op].count;
+}
+
+quint64 QHIDStats::totalTime(Operation op) const
+{
+    return histograms[op].total;
+}
+
+quint64 QHIDStats::maxTime(Operation op) const
+{
+    return histograms[op].max;
+}
+
+quint64 QHIDStats::bytes(Operation op) const
+{
+    return histograms[op].bytes;
+}
+
+quint64 QHIDStats::bucket(Operation op, int idx) const
+{
+    return idx >= 0 && idx < BucketCount ? quint64(histograms[op].buckets[idx]) : 0;
+}
+
+quint64 QHIDStats::percentile(Operation op, int percent) const
+{
+    quint64 counts[BucketCount];
+    quint64 total = 0;
+
+    // The counters may change meanwhile, so work on a snapshot.
+    for (int idx = 0; idx < BucketCount; ++idx)
+    {
+        total += counts[idx] = histograms[op].buckets[idx];
+    }
+
+    auto threshold = (total * quint64(qBound(0, percent, 100)) + 99) / 100;
+    quint64 sum = 0;
+
+    for (int idx = 0; idx < BucketCount; ++idx)
+    {
+        sum += counts[idx];
+        if (sum > 0 && sum >= threshold)
+            return idx == 0 ? 0 : quint64(1) << idx;
+    }
+
+    return 0;
+}
+
+QString QHIDStats::summary() const
+{
+    QString text = QString("%1 %2 %3 %4 %5 %6 %7\n")
+                       .arg("operation", -12)
+                       .arg("count", 8)
+                       .arg("total ms", 10)
+                       .arg("avg us", 8)
+                       .arg("p50 us", 8)
+                       .arg("p99 us", 8)
+                       .arg("max us", 8);
+
+    for (int i = 0; i < OperationCount; ++i)
+    {
+        auto op = Operation(i);
+        auto n = count(op);
+        auto total = totalTime(op);
+
+        text += QString("%1 %2 %3 %4 %5 %6 %7\n")
+                    .arg(operationName(op), -12)
+                    .arg(n, 8)
+                    .arg(total / 1000.0, 10, 'f', 1)
+                    .arg(n ? total / n : 0, 8)
+                    .arg(percentile(op, 50), 8)
+                    .arg(percentile(op, 99), 8)
+                    .arg(maxTime(op), 8);
+    }
+
+    return text;
+}
+
+bool QHIDStats::startTrace(const QString &fileName)
+{
+    QMutexLocker lock(&traceMutex);
+
+    trace.close();
+    trace.setFileName(fileName);
+
+    if (!trace.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qWarning() << "Failed to open" << fileName << trace.errorString();
+        return false;
+    }
+
+    char header[TraceHeaderSize] = {'Q', 'H', 'I', 'D', 'T', 'R', 'C', TraceVersion};
+    trace.write(header, TraceHeaderSize);
+    traceStart = clock.nsecsElapsed();
+    tracing = true;
+    return true;
+}
+
+void QHIDStats::stopTrace()
+{
+    QMutexLocker lock(&traceMutex);
+
+    tracing = false;
+    trace.close();
+}
@@ -0,0 +1,132 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef QHIDSTATS_H
+#define QHIDSTATS_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+
+#include <atomic>
+
+// Process wide I/O instrumentation: a latency histogram per operation
+// and an optional binary trace of every single call.
+// The histograms are lock free, the trace is serialized by a mutex.
+//
+// Trace file: the "QHIDTRC" magic and the format version (1 byte),
+// followed by 16-byte little endian records:
+//   u64 start, nanoseconds since the trace was started
+//   u32 duration, microseconds
+//   u8  operation
+//   u8  tag, the report number or the command
+//   i16 result, the number of bytes transferred or the error
+class QHIDStats
+{
+public:
+    enum Operation
+    {
+        SendFeatureReport,
+        GetFeatureReport,
+        Write,
+        Read,
+        Sleep,
+        OperationCount,
+    };
+
+    enum Constants
+    {
+        // Bucket N holds the durations in [2^(N-1), 2^N) microseconds.
+        BucketCount = 32,
+        TraceVersion = 1,
+        TraceHeaderSize = 8,
+        TraceRecordSize = 16,
+    };
+
+    // Measures one call, done() records it.
+    class Timer
+    {
+    public:
+        Timer(Operation op, int tag, bool enabled = true)
+            : op(op)
+            , tag(tag)
+            , enabled(enabled)
+        {
+            timer.start();
+        }
+
+        int done(int result)
+        {
+            if (enabled)
+                QHIDStats::instance()->record(op, tag, timer.nsecsElapsed(), result);
+            return result;
+        }
+
+    private:
+        Operation op;
+        int tag;
+        bool enabled;
+        QElapsedTimer timer;
+    };
+
+    static QHIDStats *instance();
+    static const char *operationName(Operation op);
+
+    void record(Operation op, int tag, qint64 nsecs, int result);
+    void reset();
+
+    quint64 count(Operation op) const;
+    // In microseconds.
+    quint64 totalTime(Operation op) const;
+    quint64 maxTime(Operation op) const;
+    // The bytes transferred by the successful calls.
+    quint64 bytes(Operation op) const;
+    quint64 bucket(Operation op, int idx) const;
+    // The upper bound of the bucket the percentile falls into, in microseconds.
+    quint64 percentile(Operation op, int percent) const;
+
+    // A table of all the operations, for humans.
+    QString summary() const;
+
+    bool startTrace(const QString &fileName);
+    void stopTrace();
+
+private:
+    QHIDStats();
+    ~QHIDStats();
+
+    struct Histogram
+    {
+        std::atomic<quint64> count;
+        std::atomic<quint64> total;
+        std::atomic<quint64> max;
+        std::atomic<quint64> bytes;
+        std::atomic<quint64> buckets[BucketCount];
+    };
+
+    Histogram histograms[OperationCount];
+    QElapsedTimer clock;
+
+    std::atomic<bool> tracing;
+    QMutex traceMutex;
+    QFile trace;
+    qint64 traceStart;
+};
+
+#endif // QHIDSTATS_H
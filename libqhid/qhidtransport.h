@@ -0,0 +1,50 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef QHIDTRANSPORT_H
+#define QHIDTRANSPORT_H
+
+// The raw I/O primitives of a single HID interface.
+// Every platform backend implements this interface, and so can any
+// software stand-in (e.g. a simulated device for benchmarks).
+class QHIDTransport
+{
+public:
+    virtual ~QHIDTransport()
+    {
+    }
+
+    virtual bool isValid() const = 0;
+
+    // Feature reports, the first byte is the report number.
+    virtual int sendFeatureReport(const char *buffer, int length) = 0;
+    virtual int getFeatureReport(char *buffer, int length) = 0;
+
+    // Interrupt transfers. The written buffer starts with the report number,
+    // the read one does not.
+    virtual int write(const char *buffer, int length) = 0;
+    virtual int read(char *buffer, int length, int timeout) = 0;
+
+    // A descriptor which becomes readable when the input arrives, -1 if there is none.
+    virtual int handle() const
+    {
+        return -1;
+    }
+};
+
+#endif // QHIDTRANSPORT_H
@@ -0,0 +1,165 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "commandinterpreter.h"
+#include "kb390l.h"
+
+#include <QFile>
+#include <QRegExp>
+#include <QStringList>
+
+struct Flag
+{
+    const char *name;
+    int (KB390L::*get)();
+    void (KB390L::*set)(int);
+    int min;
+    int max;
+    // The device value multiplied by the scale is what the user sees.
+    int scale;
+};
+
+static const Flag flags[] = {
+    {"rate", &KB390L::reportRate, &KB390L::setReportRate,
+        PageLayout::ReportRate::minimum, PageLayout::ReportRate::maximum, 1},
+    {"response-time", &KB390L::responseTime, &KB390L::setResponseTime,
+        PageLayout::ResponseTime::minimum, PageLayout::ResponseTime::maximum, 2},
+    {"game-mode", &KB390L::gameMode, &KB390L::setGameMode,
+        PageLayout::GameMode::minimum, PageLayout::GameMode::maximum, 1},
+    {"light-type", &KB390L::lightType, &KB390L::setLightType,
+        PageLayout::LightType::minimum, PageLayout::LightType::maximum, 1},
+    {"light-delay", &KB390L::LightDelay, &KB390L::setLightDelay,
+        PageLayout::LightDelay::minimum, PageLayout::LightDelay::maximum, 1},
+    {"light-brightness", &KB390L::lightBrightness, &KB390L::setLightBrightness,
+        PageLayout::LightBrightness::minimum, PageLayout::LightBrightness::maximum, 1},
+    {"light-direction", &KB390L::lightDirection, &KB390L::setLightDirection,
+        PageLayout::LightDirection::minimum, PageLayout::LightDirection::maximum, 1},
+};
+
+static const Flag *findFlag(const QString &name)
+{
+    foreach (const auto &flag, flags)
+    {
+        if (name == flag.name)
+            return &flag;
+    }
+
+    return nullptr;
+}
+
+static bool isOnOff(const Flag *flag)
+{
+    return flag->set == &KB390L::setGameMode;
+}
+
+CommandInterpreter::CommandInterpreter(KB390L *kb)
+    : kb(kb)
+{
+}
+
+QString CommandInterpreter::execute(const QString &line)
+{
+    auto args = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+
+    if (args.isEmpty())
+        return "error empty command";
+
+    auto cmd = args.front();
+    // The file name may contain spaces
+    auto rest = line.trimmed().mid(cmd.length()).trimmed();
+
+    if (cmd == "ping")
+    {
+        return kb->ping() ? "ok" : "error no device";
+    }
+
+    if (cmd == "get" && args.size() == 2)
+    {
+        auto flag = findFlag(args[1]);
+        if (!flag)
+            return "error unknown flag " + args[1];
+
+        auto value = (kb->*flag->get)();
+        if (value < 0)
+            return "error no device";
+
+        return "ok " + (isOnOff(flag) ? QString(value ? "on" : "off") : QString::number(value * flag->scale));
+    }
+
+    if (cmd == "set" && args.size() == 3)
+    {
+        auto flag = findFlag(args[1]);
+        if (!flag)
+            return "error unknown flag " + args[1];
+
+        bool ok = true;
+        auto value = isOnOff(flag) ? int(args[2].compare("off", Qt::CaseInsensitive) != 0 && args[2] != "0")
+                                   : args[2].toInt(&ok) / flag->scale;
+
+        if (!ok || value < flag->min || value > flag->max)
+            return "error invalid value " + args[2];
+
+        (kb->*flag->set)(value);
+        return "ok";
+    }
+
+    if (cmd == "backup" && !rest.isEmpty())
+    {
+        QFile file(rest);
+        if (!file.open(QFile::WriteOnly))
+            return "error failed to open " + rest;
+
+        return kb->backupConfig(&file) ? "ok" : "error failed to read the config";
+    }
+
+    if (cmd == "restore" && !rest.isEmpty())
+    {
+        QFile file(rest);
+        if (!file.open(QFile::ReadOnly))
+            return "error failed to open " + rest;
+
+        return kb->restoreConfig(&file) ? "ok" : "error failed to write the config";
+    }
+
+    if (cmd == "recover" && args.size() == 1)
+    {
+        return kb->recoverJournal() ? "ok" : "error failed to roll back the interrupted restore";
+    }
+
+    if (cmd == "profiles" && args.size() == 1)
+    {
+        return QString("ok %1").arg(KB390L::profiles().join(' ')).trimmed();
+    }
+
+    if (cmd == "save-profile" && args.size() == 2)
+    {
+        return kb->saveProfile(args[1]) ? "ok" : "error failed to save the profile " + args[1];
+    }
+
+    if (cmd == "switch-profile" && args.size() == 2)
+    {
+        return kb->switchProfile(args[1]) ? "ok" : "error failed to switch to the profile " + args[1];
+    }
+
+    if (cmd == "reset" && args.size() == 1)
+    {
+        return kb->resetToFactoryDefaults() ? "ok" : "error no device";
+    }
+
+    return "error unknown command " + line.trimmed();
+}
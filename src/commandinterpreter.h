@@ -0,0 +1,51 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef COMMANDINTERPRETER_H
+#define COMMANDINTERPRETER_H
+
+#include <QString>
+
+class KB390L;
+
+// Executes the text commands, one per line:
+//   ping
+//   get <flag>
+//   set <flag> <value>
+//   backup <file>
+//   restore <file>
+//   recover
+//   reset
+//   profiles
+//   save-profile <name>
+//   switch-profile <name>
+// where the flag is one of rate, response-time (msecs), game-mode (on|off),
+// light-type, light-delay, light-brightness, light-direction.
+// The reply is "ok", "ok <value>" or "error <message>".
+class CommandInterpreter
+{
+public:
+    explicit CommandInterpreter(KB390L *kb);
+
+    QString execute(const QString &line);
+
+private:
+    KB390L *kb;
+};
+
+#endif // COMMANDINTERPRETER_H
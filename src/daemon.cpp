@@ -0,0 +1,92 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "daemon.h"
+#include "kb390l.h"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+
+Daemon::Daemon(KB390L *kb, QObject *parent)
+    : QObject(parent)
+    , server(new QLocalServer(this))
+    , interpreter(kb)
+{
+    connect(server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+}
+
+bool Daemon::listen(const QString &name)
+{
+    // Another instance is serving already, do not steal its socket.
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(1000))
+    {
+        qCWarning(UsbIo) << "Another daemon is listening on" << name;
+        return false;
+    }
+
+    // Otherwise a stale socket of a crashed instance.
+    QLocalServer::removeServer(name);
+
+    // The commands rewrite the keyboard, keep the other users out.
+    server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!server->listen(name))
+    {
+        qCWarning(UsbIo) << "Failed to listen on" << name << server->errorString();
+        return false;
+    }
+
+    return true;
+}
+
+QString Daemon::serverName() const
+{
+    return server->fullServerName();
+}
+
+void Daemon::newConnection()
+{
+    while (server->hasPendingConnections())
+    {
+        auto socket = server->nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void Daemon::readyRead()
+{
+    auto socket = qobject_cast<QLocalSocket *>(sender());
+
+    while (socket && socket->canReadLine())
+    {
+        auto line = QString::fromUtf8(socket->readLine()).trimmed();
+
+        if (line.isEmpty())
+            continue;
+
+        if (line == "quit")
+        {
+            socket->disconnectFromServer();
+            return;
+        }
+
+        socket->write(interpreter.execute(line).toUtf8().append('\n'));
+    }
+}
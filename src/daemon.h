@@ -0,0 +1,50 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "commandinterpreter.h"
+
+#include <QObject>
+
+class KB390L;
+
+// Serves the CommandInterpreter protocol over a local socket. The device
+// stays open and the page cache warm between the requests, so a request
+// costs no enumeration or device open.
+class Daemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Daemon(KB390L *kb, QObject *parent = nullptr);
+
+    bool listen(const QString &name);
+    QString serverName() const;
+
+private slots:
+    void newConnection();
+    void readyRead();
+
+private:
+    class QLocalServer *server;
+    CommandInterpreter interpreter;
+};
+
+#endif // DAEMON_H
@@ -17,11 +17,22 @@
  */
 
 #include "kb390l.h"
+#include "profile.h"
 #include "qhiddevice.h"
 #include "qhidmonitor.h"
 
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegExp>
 #include <QRgb>
+#include <QSaveFile>
+#include <QSocketNotifier>
+#include <QStandardPaths>
 #include <QThread>
+#include <QWaitCondition>
+
+#include <deque>
 
 #define VENDOR  0x04D9
 #define PRODUCT 0xA131
@@ -29,8 +40,17 @@
 #define GENERIC_USAGE      0x0001
 #define EVENT_USAGE_PAGE   0xFF02
 #define EVENT_USAGE        0x0001
+// Given by 51-hv-kb390l-keyboard.rules
+#define UDEV_TAG "hv_kb390l"
+
+// The event reader thread wakes up this often to check whether it should stop.
+// Not used with the backends that have a descriptor to watch.
+#define EVENT_READ_TIMEOUT 1000
 
-#define PAGE_SIZE 64
+// Max number of page requests in flight
+#define MAX_PIPELINE_DEPTH 4
+// How many times the pages that failed the verification are rewritten
+#define VERIFY_RETRIES 2
 
 Q_LOGGING_CATEGORY(UsbIo, "usb")
 
@@ -39,6 +59,9 @@ Q_LOGGING_CATEGORY(UsbIo, "usb")
 #define qCInfo qCWarning
 #endif
 
+static_assert(KB390L::ButtonTable::Count <= PageLayout::Buttons::count, "the key is out of the button table");
+static_assert(KB390L::ButtonTable::Count <= PageLayout::EnabledButtons::count, "the key is out of the enabled bitmap");
+
 static char crc(const QByteArray data)
 {
     char sum = -1;
@@ -51,66 +74,385 @@ static char crc(const QByteArray data)
     return sum;
 }
 
+// The ping, answered once the keyboard has completed the write.
+static QByteArray readyProbe()
+{
+    QByteArray data(9, '\x0');
+    data[1] = char(KB390L::CmdPing | KB390L::CmdFlagGet);
+    data[8] = crc(data);
+    return data;
+}
+
+static std::vector<KB390L::PageId> backupPages()
+{
+    std::vector<KB390L::PageId> pages;
+    pages.push_back(KB390L::PageId(KB390L::CmdReportRate, 0));
+    pages.push_back(KB390L::PageId(KB390L::CmdResponseTime, 0));
+    pages.push_back(KB390L::PageId(KB390L::CmdControl, 0));
+    pages.push_back(KB390L::PageId(KB390L::CmdGameMode, 0));
+    pages.push_back(KB390L::PageId(KB390L::CmdButtons, 0));
+    pages.push_back(KB390L::PageId(KB390L::CmdEnabledButtons, 0));
+    for (int i = KB390L::MinMacroNum; i <= KB390L::MaxMacroNum; ++i)
+    {
+        pages.push_back(KB390L::PageId(KB390L::CmdMacro, i));
+    }
+
+    return pages;
+}
+
+// Flags are single feature reports rather than pages.
+static bool isFlag(int cacheId)
+{
+    return PageCache::slot(cacheId) >= PageCache::SlotFlag;
+}
+
+struct KB390L::Job
+{
+    int id;
+    bool success;
+    // The written pages replace the unsaved edits, as the restore does.
+    bool replace;
+    // Pages read from the device
+    std::map<int, QByteArray> fetched;
+    // Pages written to the device
+    std::map<int, QByteArray> written;
+    // Called on the owner thread once the job is done, before finished().
+    std::function<void(bool)> done;
+};
+
+// Runs the posted jobs one by one.
+class KB390L::IoThread : public QThread
+{
+public:
+    explicit IoThread(QObject *parent)
+        : QThread(parent)
+        , stopping(false)
+    {
+    }
+
+    void post(const std::function<void()> &job)
+    {
+        QMutexLocker lock(&mutex);
+        queue.push_back(job);
+        jobAdded.wakeOne();
+    }
+
+    // Finish all pending jobs and exit.
+    void stop()
+    {
+        {
+            QMutexLocker lock(&mutex);
+            stopping = true;
+            jobAdded.wakeOne();
+        }
+        wait();
+    }
+
+protected:
+    void run() override
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                QMutexLocker lock(&mutex);
+                while (queue.empty() && !stopping)
+                    jobAdded.wait(&mutex);
+
+                if (queue.empty())
+                    return;
+
+                job = queue.front();
+                queue.pop_front();
+            }
+            job();
+        }
+    }
+
+private:
+    QMutex mutex;
+    QWaitCondition jobAdded;
+    std::deque<std::function<void()>> queue;
+    bool stopping;
+};
+
+// Waits for the notifications from the event interface and passes them
+// to the owner thread. The descriptor of the device is watched by the event
+// loop if the backend has one, otherwise a thread blocks in the reads.
+class KB390L::EventReader : public QThread
+{
+public:
+    EventReader(QHIDDevice *device, KB390L *kb)
+        : QThread(kb)
+        , device(device)
+        , kb(kb)
+        , notifier(nullptr)
+    {
+        // The reads mostly wait for the user, the timings would be noise.
+        device->setInstrumented(false);
+    }
+
+    void listen()
+    {
+        auto fd = device->handle();
+        if (fd < 0)
+        {
+            // The reads of the previous device are over, see stop().
+            join();
+            start();
+            return;
+        }
+
+        notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        connect(notifier, SIGNAL(activated(int)), kb, SLOT(eventAvailable()));
+    }
+
+    // Does not wait for the thread, it leaves on the next read timeout or
+    // at once if the device is gone. Call join() before reopening the device.
+    void stop()
+    {
+        if (notifier)
+        {
+            delete notifier;
+            notifier = nullptr;
+            return;
+        }
+
+        stopping.store(1);
+    }
+
+    void join()
+    {
+        wait();
+        stopping.store(0);
+    }
+
+    // Called by the owner when the descriptor is readable.
+    void readAvailable()
+    {
+        char buffer[4];
+        int read;
+
+        while ((read = device->read(buffer, sizeof(buffer), 0)) == sizeof(buffer))
+        {
+            kb->eventReceived(QByteArray(buffer, sizeof(buffer)));
+        }
+
+        if (read < 0)
+        {
+            // Most likely unplugged, the monitor will tell.
+            qCWarning(UsbIo) << "event read failed" << read;
+            notifier->setEnabled(false);
+        }
+    }
+
+protected:
+    void run() override
+    {
+        char buffer[4];
+
+        while (!stopping.load())
+        {
+            auto read = device->read(buffer, sizeof(buffer), EVENT_READ_TIMEOUT);
+
+            // A timeout reads nothing, an error means the device is gone.
+            if (read < 0)
+            {
+                if (!stopping.load())
+                    qCWarning(UsbIo) << "event read failed" << read;
+                return;
+            }
+
+            if (read == sizeof(buffer))
+            {
+                QMetaObject::invokeMethod(kb, "eventReceived", Qt::QueuedConnection,
+                    Q_ARG(QByteArray, QByteArray(buffer, sizeof(buffer))));
+            }
+        }
+    }
+
+private:
+    QHIDDevice *device;
+    KB390L *kb;
+    QSocketNotifier *notifier;
+    QAtomicInt stopping;
+};
+
 KB390L::KB390L(QObject *parent)
+    : KB390L(QString(), parent)
+{
+}
+
+KB390L::KB390L(const QString &path, QObject *parent)
     : QObject(parent)
-    , device(new QHIDDevice(VENDOR, PRODUCT, GENERIC_USAGE_PAGE, GENERIC_USAGE, this))
-    , eventDevice(new QHIDDevice(VENDOR, PRODUCT, EVENT_USAGE_PAGE, EVENT_USAGE, this))
-    , monitor(new QHIDMonitor(VENDOR, PRODUCT, this))
-    , timerId(0)
+    , devicePath(path)
+    , device(new QHIDDevice(VENDOR, PRODUCT, GENERIC_USAGE_PAGE, GENERIC_USAGE, path, this))
+    , eventDevice(new QHIDDevice(VENDOR, PRODUCT, EVENT_USAGE_PAGE, EVENT_USAGE, path, this))
+    , monitor(new QHIDMonitor(VENDOR, PRODUCT, UDEV_TAG, this))
+    , eventReader(new EventReader(eventDevice, this))
+    , ioMutex(QMutex::Recursive)
+    , ioThread(new IoThread(this))
+    , online(false)
+    , lastRequestId(0)
+    , verify(false)
+    , deferFlags(false)
+    , pipeline(1)
 {
+    ioThread->start();
+    device->setReadyProbe(readyProbe());
+
     connect(monitor, SIGNAL(deviceArrival(QString)), this, SLOT(deviceArrival(QString)));
-    connect(monitor, SIGNAL(deviceRemove()), this, SLOT(deviceRemove()));
+    connect(monitor, SIGNAL(deviceRemove(QString)), this, SLOT(deviceRemove(QString)));
+
+    online = device->isValid();
+    if (online)
+    {
+        checkJournal();
+    }
 
     if (eventDevice->isValid()/*TODO && !report(CmdEventMask, EventAll).isNull()*/)
     {
-        timerId = startTimer(10);
+        eventReader->listen();
+    }
+}
+
+KB390L::KB390L(QHIDDevice *device, QHIDDevice *eventDevice, QObject *parent)
+    : QObject(parent)
+    , device(device)
+    , eventDevice(eventDevice)
+    , monitor(nullptr)
+    , eventReader(new EventReader(eventDevice, this))
+    , ioMutex(QMutex::Recursive)
+    , ioThread(new IoThread(this))
+    , online(false)
+    , lastRequestId(0)
+    , verify(false)
+    , deferFlags(false)
+    , pipeline(1)
+{
+    ioThread->start();
+
+    device->setParent(this);
+    device->setReadyProbe(readyProbe());
+    eventDevice->setParent(this);
+
+    if (eventDevice->isValid())
+    {
+        eventReader->listen();
     }
 }
 
 KB390L::~KB390L()
 {
-    if (timerId)
+    eventReader->stop();
+    eventReader->join();
+
+    // The pending jobs are using the device, let them finish.
+    ioThread->stop();
+
+    for (auto job : jobs)
     {
-        killTimer(timerId);
-        timerId = 0;
+        delete job.second;
     }
 }
 
+QStringList KB390L::enumerate()
+{
+    return QHIDDevice::enumerate(VENDOR, PRODUCT);
+}
+
+bool KB390L::canEnumerate()
+{
+    return QHIDDevice::canEnumerate();
+}
+
+QString KB390L::path() const
+{
+    return devicePath;
+}
+
+// Whether the path from the monitor is the device; on Windows the monitor
+// reports the device name, and the path is a part of it.
+static bool isDevicePath(const QString &eventPath, const QString &path)
+{
+#ifdef Q_OS_WIN32
+    return eventPath.contains(path, Qt::CaseInsensitive);
+#else
+    return eventPath == path;
+#endif
+}
+
 void KB390L::deviceArrival(const QString &path)
 {
     qCInfo(UsbIo) << "Detected device arrival at" << path;
-    auto connected = device->open(VENDOR, PRODUCT, GENERIC_USAGE_PAGE, GENERIC_USAGE) && ping();
-    connectChanged(connected);
-    if (connected)
-    {
-        eventDevice->open(VENDOR, PRODUCT, EVENT_USAGE_PAGE, EVENT_USAGE);
-    }
+
+    // Not the keyboard we were asked for, or another one while ours is still here.
+    // A quick replug of ours comes without the removal, so reopen it then.
+    auto another = devicePath.isEmpty()
+        ? online && !device->path().isEmpty() && !isDevicePath(path, device->path())
+        : !isDevicePath(path, devicePath);
+
+    if (another)
+        return;
+
+    // It may be another keyboard now, or the same one configured elsewhere.
+    cache.clear();
+
+    // Reopened on the I/O thread, a running job holds the device for a while.
+    auto job = new Job{++lastRequestId, false, false, {}, {}, {}};
+    job->done = [this](bool connected) {
+        online = connected;
+        connectChanged(connected);
+        if (connected)
+        {
+            checkJournal();
+            eventReader->stop();
+            eventReader->join();
+            if (eventDevice->open(VENDOR, PRODUCT, EVENT_USAGE_PAGE, EVENT_USAGE, devicePath))
+                eventReader->listen();
+        }
+    };
+
+    postJob(job, [this]() {
+        QMutexLocker lock(&ioMutex);
+        return device->open(VENDOR, PRODUCT, GENERIC_USAGE_PAGE, GENERIC_USAGE, devicePath) && ping();
+    });
 }
 
-void KB390L::deviceRemove()
+void KB390L::deviceRemove(const QString &path)
 {
-    qCInfo(UsbIo) << "Detected device removal";
-    if (timerId)
-    {
-        killTimer(timerId);
-        timerId = 0;
-    }
+    qCInfo(UsbIo) << "Detected device removal at" << path;
+
+    // Another keyboard was unplugged. Without the path of ours (e.g. on Windows) take it for ours.
+    auto ours = device->path();
+    if (!online || (!ours.isEmpty() && !isDevicePath(path, ours)))
+        return;
+
+    online = false;
+    cache.clear();
+    eventReader->stop();
     connectChanged(false);
 }
 
 QByteArray KB390L::report(Command b1, char b2, char b3, char b4, char b5, char b6, char b7)
 {
-    QByteArray data;
-    data.reserve(9);
-    data.push_back('\x0');
-    data.push_back(char(b1));
-    data.push_back(b2);
-    data.push_back(b3);
-    data.push_back(b4);
-    data.push_back(b5);
-    data.push_back(b6);
-    data.push_back(b7);
-    data.push_back(crc(data));
+    QMutexLocker lock(&ioMutex);
+
+    // The same buffer for every report, the callers keeping the answer detach it.
+    auto &data = reportBuffer;
+    if (data.size() != PageLayout::ReportSize)
+        data.resize(PageLayout::ReportSize);
+
+    data[0] = '\x0';
+    data[1] = char(b1);
+    data[2] = b2;
+    data[3] = b3;
+    data[4] = b4;
+    data[5] = b5;
+    data[6] = b6;
+    data[7] = b7;
+    data[8] = '\x0';
+    data[8] = crc(data);
 
     qCDebug(UsbIo) << "send" << data.toHex();
     int sent = device->sendFeatureReport(data.cbegin(), data.length());
@@ -132,14 +474,24 @@ QByteArray KB390L::report(Command b1, char b2, char b3, char b4, char b5, char b
     return data;
 }
 
-QByteArray KB390L::readPage(Command page, int idx)
+PageView KB390L::readPage(Command page, int idx)
+{
+    auto slot = loadPage(page, idx);
+    return slot < 0 ? PageView() : cache.view(slot);
+}
+
+int KB390L::loadPage(Command page, int idx)
 {
-    auto cacheId = idx << 8 | page;
-    auto iter = cache.find(cacheId);
+    auto slot = PageCache::slot(idx << 8 | page);
+
+    if (slot < 0 || (!cache.isValid(slot) && !readPages({PageId(page, idx)})))
+        return -1;
 
-    if (iter != cache.end())
-        return iter->second;
+    return slot;
+}
 
+int KB390L::requestPage(Command page, int idx)
+{
     auto cmd = Command(CmdFlagGet | page);
     auto resp = report(cmd, 0, char(idx));
 
@@ -147,34 +499,152 @@ QByteArray KB390L::readPage(Command page, int idx)
             || resp.at(3) != idx)
     {
         qCWarning(UsbIo) << "readPage: invalid response:" << resp.toHex();
-        return nullptr;
+        return -1;
     }
 
-    int numBytes = (page == CmdEnabledButtons ? 1 : resp.at(4)) * PAGE_SIZE;
-    QByteArray value(numBytes, 0);
+    return (page == CmdEnabledButtons ? 1 : resp.at(4)) * PageLayout::PageSize;
+}
+
+PageView KB390L::receivePage(Command page, int idx, int numBytes)
+{
+    // Reused for every page, the callers copy it where it belongs.
+    if (rxBuffer.size() != numBytes)
+        rxBuffer.resize(numBytes);
 
-    auto read = device->read(value.begin(), numBytes);
+    auto read = device->read(rxBuffer.data(), numBytes);
     if (read != numBytes)
     {
         qCWarning(UsbIo) << "readPage: read failed: got" << read << "expected" << numBytes;
-        return nullptr;
+        return PageView();
+    }
+
+    qCDebug(UsbIo) << "readPage" << page << idx << rxBuffer.toHex();
+    return PageView(rxBuffer);
+}
+
+bool KB390L::flushInput(int numBytes)
+{
+    // Drop the data of a request we are not going to receive. It may still be
+    // on the way, so wait for it as long as for the data we do want.
+    char buffer[PageLayout::PageSize];
+    while (numBytes > 0)
+    {
+        auto read = device->read(buffer, qMin(numBytes, int(sizeof(buffer))));
+        if (read <= 0)
+            return false;
+
+        numBytes -= read;
+    }
+
+    return true;
+}
+
+std::vector<KB390L::PageId> KB390L::missingPages(const std::vector<PageId> &pages) const
+{
+    std::vector<PageId> missing;
+
+    foreach (auto id, pages)
+    {
+        auto slot = PageCache::slot(id.second << 8 | id.first);
+        if (slot < 0 || !cache.isValid(slot))
+            missing.push_back(id);
+    }
+
+    return missing;
+}
+
+bool KB390L::fetchPages(const std::vector<PageId> &pages, std::map<int, QByteArray> *result, int requestId)
+{
+    return fetchPages(pages, [result](int cacheId, const PageView &value) { (*result)[cacheId] = value.toByteArray(); },
+        requestId);
+}
+
+bool KB390L::fetchPages(
+    const std::vector<PageId> &pages, const std::function<void(int, const PageView &)> &sink, int requestId)
+{
+    struct Pending
+    {
+        PageId id;
+        int numBytes;
+    };
+    std::deque<Pending> pending;
+    bool ok = true;
+    int done = 0;
+    int total = int(pages.size());
+
+    QMutexLocker lock(&ioMutex);
+
+    for (auto iter = pages.cbegin(); ok && (iter != pages.cend() || !pending.empty());)
+    {
+        if (iter != pages.cend() && isFlag(iter->first))
+        {
+            // Nothing to pipeline here.
+            auto id = *iter++;
+            auto resp = report(Command(id.first | CmdFlagGet));
+            ok = !resp.isNull();
+
+            if (ok)
+            {
+                sink(id.first, PageView(resp));
+                emit progress(requestId, ++done, total);
+            }
+            continue;
+        }
+
+        // Keep up to pipelineDepth requests in flight, then receive the oldest one.
+        if (iter != pages.cend() && int(pending.size()) < pipeline)
+        {
+            auto id = *iter++;
+            auto numBytes = requestPage(id.first, id.second);
+            ok = numBytes >= 0;
+            if (ok)
+                pending.push_back({id, numBytes});
+            continue;
+        }
+
+        auto next = pending.front();
+        pending.pop_front();
+        auto value = receivePage(next.id.first, next.id.second, next.numBytes);
+        ok = !value.isNull();
+
+        if (ok)
+        {
+            sink(next.id.second << 8 | next.id.first, value);
+            emit progress(requestId, ++done, total);
+        }
     }
 
-    qCDebug(UsbIo) << "readPage" << page << idx << value.toHex();
+    // Otherwise the late chunks would be taken for the start of the next page.
+    while (!ok && !pending.empty() && flushInput(pending.front().numBytes))
+        pending.pop_front();
 
-    dirtyPages[cacheId] = false;
-    return cache[cacheId] = value;
+    return ok;
+}
+
+bool KB390L::readPages(const std::vector<PageId> &pages)
+{
+    // Straight into the cache, keeping the pages we've got even on failure.
+    return fetchPages(missingPages(pages),
+        [this](int cacheId, const PageView &value) {
+            auto slot = PageCache::slot(cacheId);
+            if (slot >= 0)
+                cache.store(slot, value);
+        },
+        0);
 }
 
 bool KB390L::writePage(const QByteArray &data, Command page, int idx)
 {
+    // Always the whole page: the byte 2 looks like the first chunk to write,
+    // but no firmware revision is confirmed to honour it.
     QByteArray cmd(9, '\x0');
     cmd[1] = char(page);
     cmd[2] = 0;
     cmd[3] = char(idx);
-    cmd[4] = char(page == CmdEnabledButtons ? 18 : data.length() / PAGE_SIZE);
+    cmd[4] = char(page == CmdEnabledButtons ? PageLayout::EnabledButtons::size : data.length() / PageLayout::PageSize);
     cmd[8] = crc(cmd);
 
+    QMutexLocker lock(&ioMutex);
     qCDebug(UsbIo) << "send" << cmd.toHex();
     int sent = device->sendFeatureReport(cmd.cbegin(), cmd.length());
     if (sent != cmd.length())
@@ -184,150 +654,250 @@ bool KB390L::writePage(const QByteArray &data, Command page, int idx)
     }
 
     qCDebug(UsbIo) << "writePage" << page << idx << data.toHex();
-    auto written = device->write(0, data, data.length());
+    auto written = device->write(0, data.constData(), data.length());
     if (written != data.length())
     {
         qCWarning(UsbIo) << "writePage: write failed: got" << written << "expected" << data.length();
         return false;
     }
 
-    auto cacheId = idx << 8 | page;
-    dirtyPages[cacheId] = false;
     return true;
 }
 
-int KB390L::button(KeyIndex btn)
+bool KB390L::writeEntry(int cacheId, const QByteArray &data)
 {
-    auto bytes = readPage(CmdButtons);
+    auto cmd = Command(0xFF & cacheId);
+    auto idx = 0xFF & (cacheId >> 8);
 
-    if (bytes.isEmpty())
-        return -1;
+    if (isFlag(cacheId))
+        return !report(cmd, data[2], data[3], data[4], data[5], data[6], data[7]).isNull();
 
-    auto btns = reinterpret_cast<const int *>(bytes.constData());
-    return btns[btn];
+    return writePage(data, cmd, idx);
 }
 
-void KB390L::setButton(KeyIndex btn, int value)
+bool KB390L::writePages(const std::map<int, QByteArray> &pages, std::map<int, QByteArray> *written, int requestId)
 {
-    auto bytes = readPage(CmdButtons);
+    int done = 0;
+    int total = int(pages.size());
+
+    QMutexLocker lock(&ioMutex);
 
-    if (!bytes.isEmpty())
+    foreach (auto page, pages)
     {
-        auto btns = reinterpret_cast<int *>(bytes.data());
+        if (!writeEntry(page.first, page.second))
+            return false;
 
-        if (btns[btn] != value)
+        (*written)[page.first] = page.second;
+        emit progress(requestId, ++done, total);
+    }
+
+    if (!verify || verifyPages(pages, requestId))
+        return true;
+
+    // Whatever the device has now, it is not what we wrote.
+    foreach (auto page, pages)
+    {
+        (*written)[page.first] = QByteArray();
+    }
+
+    return false;
+}
+
+bool KB390L::verifyPages(const std::map<int, QByteArray> &pages, int requestId)
+{
+    std::vector<PageId> ids;
+    foreach (auto page, pages)
+    {
+        ids.push_back(PageId(Command(0xFF & page.first), 0xFF & (page.first >> 8)));
+    }
+
+    for (int attempt = 0;; ++attempt)
+    {
+        // Read everything back in one batch, compared as received.
+        std::vector<PageId> mismatched;
+        auto compare = [&pages, &mismatched](int cacheId, const PageView &value) {
+            if (value != PageView(pages.at(cacheId)))
+                mismatched.push_back(PageId(Command(0xFF & cacheId), 0xFF & (cacheId >> 8)));
+        };
+
+        if (!fetchPages(ids, compare, requestId))
+            return false;
+
+        if (mismatched.empty())
+            return true;
+
+        if (attempt == VERIFY_RETRIES)
         {
-            dirtyPages[CmdButtons] = true;
-            btns[btn] = value;
-            cache[CmdButtons] = bytes;
+            qCWarning(UsbIo) << "verify:" << mismatched.size() << "of" << pages.size() << "pages still differ";
+            return false;
+        }
+
+        qCWarning(UsbIo) << "verify: rewriting" << mismatched.size() << "of" << pages.size() << "pages";
+
+        foreach (auto id, mismatched)
+        {
+            auto cacheId = id.second << 8 | id.first;
+            if (!writeEntry(cacheId, pages.at(cacheId)))
+                return false;
         }
+
+        ids.swap(mismatched);
+    }
+}
+
+int KB390L::button(KeyIndex btn)
+{
+    auto slot = loadPage(CmdButtons);
+
+    if (slot < 0)
+        return -1;
+
+    return PageLayout::Buttons::get(cache.data(slot), btn);
+}
+
+void KB390L::setButton(KeyIndex btn, int value)
+{
+    auto slot = loadPage(CmdButtons);
+
+    if (slot >= 0 && PageLayout::Buttons::get(cache.data(slot), btn) != value)
+    {
+        PageLayout::Buttons::set(cache.modify(slot), btn, value);
     }
 }
 
 bool KB390L::buttonEnabled(KeyIndex btn)
 {
-    auto bytes = readPage(CmdEnabledButtons);
+    auto slot = loadPage(CmdEnabledButtons);
 
-    if (bytes.isEmpty())
+    if (slot < 0)
         return -1;
 
-    int row = btn / ButtonsPerRow;
-    auto btns = reinterpret_cast<const int *>(bytes.constData() + row * 3);
-    int bit    = btn % ButtonsPerRow;
-    int mask   = 1 << bit;
-    return 0 != (*btns & mask);
+    return PageLayout::EnabledButtons::get(cache.data(slot), btn);
 }
 
 void KB390L::setButtonEnabled(KeyIndex btn, bool value)
 {
-    auto bytes = readPage(CmdEnabledButtons);
+    auto slot = loadPage(CmdEnabledButtons);
 
-    if (!bytes.isEmpty())
+    if (slot >= 0 && PageLayout::EnabledButtons::get(cache.data(slot), btn) != value)
     {
-        int row = btn / ButtonsPerRow;
-        auto btns = reinterpret_cast<int *>(bytes.data() + row * 3);
-        int bit    = btn % ButtonsPerRow;
-        int mask   = 1 << bit;
-        bool curr  = 0 != (*btns & mask);
+        PageLayout::EnabledButtons::set(cache.modify(slot), btn, value);
+    }
+}
 
-        if (value != curr)
-        {
-            dirtyPages[CmdEnabledButtons] = true;
-            if (value)
-                *btns |= mask;
-            else
-                *btns &= ~mask;
-            cache[CmdEnabledButtons] = bytes;
-        }
+bool KB390L::buttonTable(ButtonTable *table)
+{
+    if (!readPages({PageId(CmdButtons, 0), PageId(CmdEnabledButtons, 0)}))
+        return false;
+
+    auto btns = cache.data(PageCache::SlotButtons);
+    auto bits = cache.data(PageCache::SlotEnabledButtons);
+
+    for (int i = 0; i < ButtonTable::Count; ++i)
+    {
+        table->bindings[i] = PageLayout::Buttons::get(btns, i);
+        table->enabled[i] = PageLayout::EnabledButtons::get(bits, i);
+    }
+
+    return true;
+}
+
+bool KB390L::setButtonTable(const ButtonTable &table)
+{
+    if (!readPages({PageId(CmdButtons, 0), PageId(CmdEnabledButtons, 0)}))
+        return false;
+
+    // Encode over the current pages, so the bytes the table does not cover are kept.
+    // The cache then marks the pages dirty only if they differ from the device.
+    char btns[PageCache::ButtonsSize];
+    char bits[PageLayout::EnabledButtonsSize];
+    memcpy(btns, cache.data(PageCache::SlotButtons), sizeof(btns));
+    memcpy(bits, cache.data(PageCache::SlotEnabledButtons), sizeof(bits));
+
+    for (int i = 0; i < ButtonTable::Count; ++i)
+    {
+        PageLayout::Buttons::set(btns, i, table.bindings[i]);
+        PageLayout::EnabledButtons::set(bits, i, table.enabled[i]);
     }
+
+    cache.update(PageCache::SlotButtons, QByteArray::fromRawData(btns, sizeof(btns)));
+    cache.update(PageCache::SlotEnabledButtons, QByteArray::fromRawData(bits, sizeof(bits)));
+    return true;
 }
 
 QByteArray KB390L::macro(int index)
+{
+    return readPage(CmdMacro, index).toByteArray();
+}
+
+PageView KB390L::macroView(int index)
 {
     return readPage(CmdMacro, index);
 }
 
 void KB390L::setMacro(int index, const QByteArray &value)
 {
-    auto page = readPage(CmdMacro, index);
-    if (page != value)
+    auto slot = loadPage(CmdMacro, index);
+    if (slot >= 0 && cache.view(slot) != PageView(value))
     {
-        cache[index << 8 | CmdMacro] = value;
-        dirtyPages[index << 8 | CmdMacro] = true;
+        cache.update(slot, value);
     }
 }
 
 int KB390L::readByte(Command page, int offset)
 {
-    auto bytes = readPage(page);
-    return !bytes.isEmpty() ? 0xFF & bytes[offset] : -1;
+    auto slot = loadPage(page);
+    return slot >= 0 ? 0xFF & cache.data(slot)[offset] : -1;
 }
 
 void KB390L::writeByte(Command page, int offset, int value)
 {
-    auto bytes = readPage(page);
-    if (!bytes.isEmpty())
+    auto slot = loadPage(page);
+    if (slot >= 0)
     {
-        if ((0xFF & bytes[offset]) != (0xFF & value))
+        if ((0xFF & cache.data(slot)[offset]) != (0xFF & value))
         {
-            dirtyPages[page] = true;
-            bytes[offset] = char(value);
-            cache[page] = bytes;
+            cache.modify(slot)[offset] = char(value);
         }
     }
 }
 
 int KB390L::flag(Command cmd, int offset)
 {
-    QByteArray resp;
-    auto iter = cache.find(cmd);
+    auto slot = PageCache::slot(cmd);
 
-    if (iter != cache.end())
+    if (slot < 0 || !cache.isValid(slot))
     {
-        resp = iter->second;
-    }
-    else
-    {
-        resp = report(Command(cmd | CmdFlagGet));
-        if (!resp.isNull())
+        auto resp = report(Command(cmd | CmdFlagGet));
+        if (slot < 0 || resp.isNull())
         {
-            cache[cmd] = resp;
+            return resp.length() < 8 || resp.at(1) != char(cmd | CmdFlagGet) ? -1 : (0xFF & resp.at(offset));
         }
+
+        cache.store(slot, resp);
     }
 
-    return resp.isNull() || resp.length() < 8
-        || resp.at(1) != char(cmd | CmdFlagGet) ? -1
-            : (0xFF & resp.at(offset));
+    auto resp = cache.view(slot);
+    return resp.at(1) != char(cmd | CmdFlagGet) ? -1 : (0xFF & resp.at(offset));
 }
 
 void KB390L::setFlag(Command cmd, int value, int offset)
 {
     QByteArray resp;
-    auto iter = cache.find(cmd);
+    auto slot = PageCache::slot(cmd);
+
+    if (deferFlags && slot >= 0)
+    {
+        // Written by save() along with the pages.
+        auto current = flag(cmd, offset);
+        if (current >= 0 && current != value)
+            cache.modify(slot)[offset] = char(value);
+        return;
+    }
 
-    if (iter != cache.end())
+    if (slot >= 0 && cache.isValid(slot))
     {
-        resp = iter->second;
+        resp = cache.page(slot);
     }
     else
     {
@@ -337,7 +907,11 @@ void KB390L::setFlag(Command cmd, int value, int offset)
     if (!resp.isEmpty() && resp[offset] != char(value))
     {
         resp[offset] = char(value);
-        cache[cmd] = resp;
+        if (slot >= 0)
+        {
+            // Flags are applied immediately, nothing to save later.
+            cache.store(slot, resp);
+        }
         report(cmd, resp[2], resp[3], resp[4], resp[5], resp[6], resp[7]);
     }
 }
@@ -349,9 +923,16 @@ int KB390L::reportRate()
 
 void KB390L::setReportRate(int value)
 {
-    Q_ASSERT(value >= 0 && value <= MaxReportRate);
+    Q_ASSERT(PageLayout::ReportRate::isValid(value));
+
+    if (deferFlags)
+    {
+        setFlag(CmdReportRate, value);
+        return;
+    }
 
     report(CmdReportRate, char(value));
+    cache.invalidate(PageCache::slot(CmdReportRate));
 }
 
 int KB390L::responseTime()
@@ -361,9 +942,16 @@ int KB390L::responseTime()
 
 void KB390L::setResponseTime(int value)
 {
-    Q_ASSERT(value > 0 && value <= MaxResponseTime);
+    Q_ASSERT(PageLayout::ResponseTime::isValid(value));
+
+    if (deferFlags)
+    {
+        setFlag(CmdResponseTime, value);
+        return;
+    }
 
     report(CmdResponseTime, char(value));
+    cache.invalidate(PageCache::slot(CmdResponseTime));
 }
 
 int KB390L::gameMode()
@@ -373,60 +961,71 @@ int KB390L::gameMode()
 
 void KB390L::setGameMode(int value)
 {
+    if (deferFlags)
+    {
+        setFlag(CmdGameMode, value);
+        return;
+    }
+
     report(CmdGameMode, char(value));
+    cache.invalidate(PageCache::slot(CmdGameMode));
 }
 
 int KB390L::lightType()
 {
-    return flag(CmdControl, LightTypeOffset);
+    return flag(CmdControl, PageLayout::LightType::offset);
 }
 
 void KB390L::setLightType(int value)
 {
-    Q_ASSERT(value >= 0 && value <= 240);
+    Q_ASSERT(PageLayout::LightType::isValid(value));
 
-    setFlag(CmdControl, value, LightTypeOffset);
+    setFlag(CmdControl, value, PageLayout::LightType::offset);
 }
 
 int KB390L::LightDelay()
 {
-    return flag(CmdControl, LightDelayOffset);
+    return flag(CmdControl, PageLayout::LightDelay::offset);
 }
 
 void KB390L::setLightDelay(int value)
 {
-    Q_ASSERT(value >= 0 && value <= MaxLightDelay);
+    Q_ASSERT(PageLayout::LightDelay::isValid(value));
 
-    setFlag(CmdControl, value, LightDelayOffset);
+    setFlag(CmdControl, value, PageLayout::LightDelay::offset);
 }
 
 int KB390L::lightBrightness()
 {
-    return flag(CmdControl, LightBrightnessOffset);
+    return flag(CmdControl, PageLayout::LightBrightness::offset);
 }
 
 void KB390L::setLightBrightness(int value)
 {
-    Q_ASSERT(value >= 0 && value <= MaxLightBrightness);
+    Q_ASSERT(PageLayout::LightBrightness::isValid(value));
 
-    setFlag(CmdControl, value, LightBrightnessOffset);
+    setFlag(CmdControl, value, PageLayout::LightBrightness::offset);
 }
 
 int KB390L::lightDirection()
 {
-    return flag(CmdControl, LightDirectionOffset);
+    return flag(CmdControl, PageLayout::LightDirection::offset);
 }
 
 void KB390L::setLightDirection(int value)
 {
-    Q_ASSERT(value >= 0 && value <= MaxLightDirection);
+    Q_ASSERT(PageLayout::LightDirection::isValid(value));
 
-    setFlag(CmdControl, value, LightDirectionOffset);
+    setFlag(CmdControl, value, PageLayout::LightDirection::offset);
 }
 
 bool KB390L::resetToFactoryDefaults()
 {
-     return !report(CmdReset, '\xFF').isEmpty();
+    if (report(CmdReset, '\xFF').isEmpty())
+        return false;
+
+    cache.clear();
+    return true;
 }
 
 bool KB390L::ping()
@@ -434,87 +1033,522 @@ bool KB390L::ping()
      return -1 != flag(CmdPing);
 }
 
-void KB390L::timerEvent(QTimerEvent *evt)
+void KB390L::eventAvailable()
 {
-    QObject::timerEvent(evt);
+    eventReader->readAvailable();
+}
 
-    char buffer[4];
-    while (eventDevice->read(buffer, sizeof(buffer), 20) == sizeof(buffer))
+void KB390L::eventReceived(const QByteArray &evt)
+{
+    qCDebug(UsbIo) << "event" << evt.toHex();
+    if (evt.at(0) == 4)
     {
-        qCDebug(UsbIo) << "event" << QByteArray(buffer, 4).toHex();
-        if (buffer[0] == 4)
+        switch (evt.at(1))
         {
-            switch (buffer[1])
-            {
-            case NotifyChanged:
-                cache.clear();
-                changed(this);
-                break;
-            case NotifyAdvanced:
-                genericCommand(buffer[2]);
-                break;
-            }
-        }
-        else
-        {
-            qCDebug(UsbIo) << "???" << QByteArray(buffer, 4).toHex();
+        case NotifyChanged:
+            // Only the lighting (Fn+...) and the game mode can be changed on
+            // the keyboard itself. Keep the rest, including unsaved edits.
+            cache.invalidate(PageCache::slot(CmdControl));
+            cache.invalidate(PageCache::slot(CmdGameMode));
+            changed(this);
+            break;
+        case NotifyAdvanced:
+            genericCommand(evt.at(2));
+            break;
         }
     }
+    else
+    {
+        qCDebug(UsbIo) << "???" << evt.toHex();
+    }
+}
+
+bool KB390L::verifyWrites() const
+{
+    return verify;
+}
+
+void KB390L::setVerifyWrites(bool value)
+{
+    verify = value;
+}
+
+int KB390L::pipelineDepth() const
+{
+    return pipeline;
+}
+
+void KB390L::setPipelineDepth(int value)
+{
+    pipeline = qBound(1, value, MAX_PIPELINE_DEPTH);
+}
+
+bool KB390L::adaptivePacing() const
+{
+    return device->pacing() == QHIDDevice::AdaptivePacing;
+}
+
+void KB390L::setAdaptivePacing(bool value)
+{
+    device->setPacing(value ? QHIDDevice::AdaptivePacing : QHIDDevice::FixedPacing);
+}
+
+bool KB390L::deferredFlags() const
+{
+    return deferFlags;
+}
+
+void KB390L::setDeferredFlags(bool value)
+{
+    deferFlags = value;
+}
+
+bool KB390L::isConnected() const
+{
+    return online;
+}
+
+bool KB390L::isBusy() const
+{
+    return !jobs.empty();
 }
 
 bool KB390L::unsavedChanges()
 {
-    return dirtyPages.cend() != std::find_if(dirtyPages.cbegin(), dirtyPages.cend(),
-                                    [](const std::map<int, bool>::value_type &x) { return x.second; });
+    return cache.anyDirty();
+}
+
+std::map<int, QByteArray> KB390L::modifiedPages() const
+{
+    std::map<int, QByteArray> pages;
+
+    for (int slot = 0; slot < PageCache::SlotCount; ++slot)
+    {
+        if (cache.isDirty(slot))
+            pages[PageCache::cacheId(slot)] = cache.page(slot);
+    }
+
+    return pages;
+}
+
+void KB390L::cacheWritten(const std::map<int, QByteArray> &written, bool replace)
+{
+    foreach (auto page, written)
+    {
+        auto slot = PageCache::slot(page.first);
+
+        if (page.second.isNull())
+            cache.invalidate(slot);
+        else if (replace)
+            cache.store(slot, page.second);
+        else
+            cache.commit(slot, page.second);
+    }
 }
 
 bool KB390L::save()
 {
-    foreach (auto page, cache)
+    std::map<int, QByteArray> written;
+    auto ok = writePages(modifiedPages(), &written, 0);
+
+    cacheWritten(written, false);
+    return ok;
+}
+
+void KB390L::invalidateCache()
+{
+    cache.clear();
+}
+
+bool KB390L::backupConfig(QIODevice *storage)
+{
+    if (!readPages(backupPages()))
+        return false;
+
+    Profile profile;
+    foreach (auto id, backupPages())
     {
-        if (!dirtyPages[page.first])
+        auto slot = PageCache::slot(id.second << 8 | id.first);
+        profile.setPage(PageCache::cacheId(slot), cache.page(slot));
+    }
+
+    return profile.save(storage);
+}
+
+QString KB390L::journalDevice() const
+{
+    // The port path survives the replug; on Windows only the path given by the user tells the keyboards apart.
+    auto physical = device->path();
+    return physical.isEmpty() ? devicePath : physical;
+}
+
+QString KB390L::journalPath() const
+{
+    auto id = journalDevice();
+    auto name = id.isEmpty()
+        ? QString("journal.kblp")
+        : QString("journal-%1.kblp").arg(id.replace(QRegExp("[^\\w.-]"), "_"));
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation)).filePath(name);
+}
+
+std::map<int, QByteArray> KB390L::devicePages(const std::vector<PageId> &pages) const
+{
+    std::map<int, QByteArray> stored;
+
+    foreach (auto id, pages)
+    {
+        auto slot = PageCache::slot(id.second << 8 | id.first);
+        if (slot >= 0 && cache.isValid(slot))
+            stored[PageCache::cacheId(slot)] = cache.baselinePage(slot);
+    }
+
+    return stored;
+}
+
+std::map<int, QByteArray> KB390L::cachedPages(const std::vector<PageId> &pages) const
+{
+    std::map<int, QByteArray> cached;
+
+    foreach (auto id, pages)
+    {
+        auto slot = PageCache::slot(id.second << 8 | id.first);
+        if (slot >= 0 && cache.isValid(slot))
+            cached[PageCache::cacheId(slot)] = cache.page(slot);
+    }
+
+    return cached;
+}
+
+bool KB390L::restorePages(QIODevice *storage, const std::map<int, QByteArray> &cached,
+    std::map<int, QByteArray> *written, int requestId)
+{
+    Profile profile;
+    if (!profile.load(storage))
+    {
+        qCWarning(UsbIo) << "Not a valid profile";
+        return false;
+    }
+
+    return restorePages(profile, cached, written, requestId, false);
+}
+
+bool KB390L::restorePages(const Profile &profile, const std::map<int, QByteArray> &cached,
+    std::map<int, QByteArray> *written, int requestId, bool changedOnly)
+{
+    // Snapshot the pages about to be overwritten, the cached ones are fresh.
+    std::map<int, QByteArray> current;
+    std::vector<PageId> missing;
+    foreach (auto page, profile.pages())
+    {
+        auto iter = cached.find(page.first);
+        if (iter != cached.end())
+            current[page.first] = iter->second;
+        else
+            missing.push_back(PageId(Command(0xFF & page.first), 0xFF & (page.first >> 8)));
+    }
+
+    std::map<int, QByteArray> fetched;
+    if (!fetchPages(missing, &fetched, requestId))
+        return false;
+
+    foreach (auto page, fetched)
+    {
+        current[page.first] = page.second;
+    }
+
+    std::map<int, QByteArray> pages;
+    Profile snapshot;
+    snapshot.setDevice(journalDevice());
+    foreach (auto page, profile.pages())
+    {
+        if (changedOnly && current[page.first] == page.second)
             continue;
 
-        if (!writePage(page.second, Command(0xFF & page.first), 0xFF & (page.first >> 8)))
-            return false;
+        pages[page.first] = page.second;
+        snapshot.setPage(page.first, current[page.first]);
     }
 
-    return true;
+    if (changedOnly)
+        qCInfo(UsbIo) << pages.size() << "of" << profile.pages().size() << "pages differ";
+
+    if (pages.empty())
+        return true;
+
+    // Persist the snapshot, so an interrupted restore can be rolled back on the next connect.
+    QDir().mkpath(QFileInfo(journalPath()).path());
+    QSaveFile journal(journalPath());
+    if (!journal.open(QFile::WriteOnly) || !snapshot.save(&journal) || !journal.commit())
+    {
+        qCWarning(UsbIo) << "Failed to write the journal" << journal.fileName();
+        return false;
+    }
+
+    if (writePages(pages, written, requestId))
+    {
+        QFile::remove(journalPath());
+        return true;
+    }
+
+    qCWarning(UsbIo) << "Restore failed, rolling back";
+    std::map<int, QByteArray> rolledBack;
+    if (writePages(snapshot.pages(), &rolledBack, requestId))
+    {
+        QFile::remove(journalPath());
+    }
+
+    foreach (auto page, rolledBack)
+    {
+        (*written)[page.first] = page.second;
+    }
+
+    return false;
 }
 
-bool KB390L::backupConfig(QIODevice *storage)
+bool KB390L::hasUnfinishedRestore() const
 {
-    int bytes = 0;
+    // Without the identity the journal may as well be of another keyboard.
+    return !journalDevice().isEmpty() && QFile::exists(journalPath());
+}
 
-    auto page = readPage(CmdButtons);
-    if (!page.isEmpty())
-        bytes += storage->write(page);
+void KB390L::checkJournal()
+{
+    if (journalDevice().isEmpty() && QFile::exists(journalPath()))
+    {
+        qCWarning(UsbIo) << "Found an unfinished restore of an unknown keyboard in" << journalPath()
+                         << ", restore the file by hand if it is of this one";
+        return;
+    }
+
+    if (!hasUnfinishedRestore())
+        return;
 
-    for (int i = MinMacroNum; i <= MaxMacroNum; ++i)
+    qCWarning(UsbIo) << "Found an unfinished restore, the overwritten pages are kept in" << journalPath();
+    emit unfinishedRestore();
+}
+
+bool KB390L::replayJournal(std::map<int, QByteArray> *written, int requestId)
+{
+    QFile journal(journalPath());
+    if (!journal.exists())
+        return true;
+
+    if (journalDevice().isEmpty())
+    {
+        qCWarning(UsbIo) << "The keyboard is unknown, select it by the path to recover";
+        return false;
+    }
+
+    qCInfo(UsbIo) << "Rolling back the unfinished restore from" << journal.fileName();
+
+    Profile snapshot;
+    if (!journal.open(QFile::ReadOnly) || !snapshot.load(&journal))
     {
-        page = readPage(CmdMacro, i);
-        if (!page.isEmpty())
-            bytes += storage->write(page);
+        qCWarning(UsbIo) << "The journal" << journal.fileName() << "is damaged";
+        return false;
     }
+    journal.close();
+
+    // The file names are sanitized, so two keyboards could share one.
+    if (snapshot.device() != journalDevice())
+    {
+        qCWarning(UsbIo) << "The journal belongs to" << snapshot.device() << "not to" << journalDevice();
+        return false;
+    }
+
+    auto ok = writePages(snapshot.pages(), written, requestId);
+    if (ok)
+        journal.remove();
+
+    return ok;
+}
+
+bool KB390L::recoverJournal()
+{
+    std::map<int, QByteArray> written;
+    auto ok = replayJournal(&written, 0);
+
+    cacheWritten(written, true);
+    return ok;
+}
+
+int KB390L::recoverJournalAsync()
+{
+    auto job = new Job{++lastRequestId, false, true, {}, {}, {}};
+
+    postJob(job, [this, job]() { return replayJournal(&job->written, job->id); });
+    return job->id;
+}
 
-    return bytes == PAGE_SIZE * 8 + PAGE_SIZE * 3 * 32;
+void KB390L::discardJournal()
+{
+    QFile::remove(journalPath());
 }
 
 bool KB390L::restoreConfig(QIODevice *storage)
 {
-    if (storage->size() != PAGE_SIZE * 8 + PAGE_SIZE * 3 * 32)
+    std::map<int, QByteArray> written;
+    auto ok = restorePages(storage, devicePages(backupPages()), &written, 0);
+
+    cacheWritten(written, true);
+    return ok;
+}
+
+static bool isValidProfileName(const QString &name)
+{
+    return QRegExp("[\\w-][\\w.-]*").exactMatch(name);
+}
+
+static QString profileDir()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::DataLocation)).filePath("profiles");
+}
+
+QStringList KB390L::profiles()
+{
+    QStringList names;
+
+    foreach (auto info, QDir(profileDir()).entryInfoList(QStringList("*.kblp"), QDir::Files, QDir::Name))
+    {
+        names.append(info.completeBaseName());
+    }
+
+    return names;
+}
+
+bool KB390L::saveProfile(const QString &name)
+{
+    if (!isValidProfileName(name))
+    {
+        qCWarning(UsbIo) << "Invalid profile name" << name;
         return false;
+    }
 
-    auto page = storage->read(PAGE_SIZE * 8);
-    if (page.isEmpty() || !writePage(page, CmdButtons))
+    QDir().mkpath(profileDir());
+    QSaveFile file(QDir(profileDir()).filePath(name + ".kblp"));
+
+    return file.open(QFile::WriteOnly) && backupConfig(&file) && file.commit();
+}
+
+bool KB390L::switchProfile(const QString &name)
+{
+    Profile profile;
+    QFile file(QDir(profileDir()).filePath(name + ".kblp"));
+
+    if (!isValidProfileName(name) || !file.open(QFile::ReadOnly) || !profile.load(&file))
+    {
+        qCWarning(UsbIo) << "No such profile" << name;
         return false;
+    }
+
+    // Diff against what the device has, reading is much cheaper than writing.
+    // The pages are read anew, the cache could be older than the device contents.
+    std::map<int, QByteArray> written;
+    auto ok = restorePages(profile, std::map<int, QByteArray>(), &written, 0, true);
 
-    for (int i = MinMacroNum; i <= MaxMacroNum; ++i)
+    cacheWritten(written, true);
+    return ok;
+}
+
+void KB390L::postJob(Job *job, const std::function<bool()> &fn)
+{
+    jobs[job->id] = job;
+    ioThread->post([this, job, fn]() {
+        job->success = fn();
+        QMetaObject::invokeMethod(this, "jobDone", Qt::QueuedConnection, Q_ARG(int, job->id));
+    });
+}
+
+void KB390L::jobDone(int requestId)
+{
+    auto iter = jobs.find(requestId);
+    if (iter == jobs.end())
+        return;
+
+    auto job = iter->second;
+    jobs.erase(iter);
+
+    foreach (auto page, job->fetched)
     {
-        page = storage->read(PAGE_SIZE * 3);
-        if (page.isEmpty() || !writePage(page, CmdMacro, i))
-            return false;
+        // Do not overwrite the pages modified while the job was running.
+        auto slot = PageCache::slot(page.first);
+        if (slot >= 0 && !cache.isValid(slot))
+            cache.store(slot, page.second);
     }
 
-    return true;
+    // The pages could be modified again while the job was running, commit keeps that.
+    cacheWritten(job->written, job->replace);
+
+    auto success = job->success;
+    if (job->done)
+        job->done(success);
+
+    delete job;
+    emit finished(requestId, success);
+}
+
+int KB390L::readPagesAsync(const std::vector<PageId> &pages)
+{
+    auto job = new Job{++lastRequestId, false, false, {}, {}, {}};
+    auto missing = missingPages(pages);
+
+    postJob(job, [this, job, missing]() { return fetchPages(missing, &job->fetched, job->id); });
+    return job->id;
+}
+
+int KB390L::saveAsync()
+{
+    auto job = new Job{++lastRequestId, false, false, {}, {}, {}};
+    auto pages = modifiedPages();
+
+    postJob(job, [this, job, pages]() { return writePages(pages, &job->written, job->id); });
+    return job->id;
+}
+
+int KB390L::backupConfigAsync(const QString &fileName)
+{
+    auto job = new Job{++lastRequestId, false, false, {}, {}, {}};
+    auto missing = missingPages(backupPages());
+    // The pages we already have
+    auto cached = cachedPages(backupPages());
+
+    postJob(job, [this, job, missing, cached, fileName]() {
+        if (!fetchPages(missing, &job->fetched, job->id))
+            return false;
+
+        QFile file(fileName);
+        if (!file.open(QFile::WriteOnly))
+        {
+            qCWarning(UsbIo) << "Failed to open" << fileName << "for writing";
+            return false;
+        }
+
+        Profile profile;
+        foreach (auto id, backupPages())
+        {
+            auto cacheId = id.second << 8 | id.first;
+            auto iter = cached.find(cacheId);
+            profile.setPage(cacheId, iter != cached.end() ? iter->second : job->fetched[cacheId]);
+        }
+
+        return profile.save(&file);
+    });
+    return job->id;
+}
+
+int KB390L::restoreConfigAsync(const QString &fileName)
+{
+    auto job = new Job{++lastRequestId, false, true, {}, {}, {}};
+    auto cached = devicePages(backupPages());
+
+    postJob(job, [this, job, cached, fileName]() {
+        QFile file(fileName);
+        if (!file.open(QFile::ReadOnly))
+        {
+            qCWarning(UsbIo) << "Failed to open" << fileName << "for reading";
+            return false;
+        }
+
+        return restorePages(&file, cached, &job->written, job->id);
+    });
+    return job->id;
 }
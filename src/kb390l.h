@@ -19,8 +19,17 @@
 #ifndef KB390L_H
 #define KB390L_H
 
+#include "pagecache.h"
+#include "pagelayout.h"
+
 #include <QObject>
 #include <QLoggingCategory>
+#include <QMutex>
+#include <QStringList>
+
+#include <functional>
+#include <map>
+#include <vector>
 
 Q_DECLARE_LOGGING_CATEGORY(UsbIo)
 
@@ -32,9 +41,20 @@ class KB390L : public QObject
     Q_PROPERTY(int lightDirection READ lightDirection WRITE setLightDirection)
     Q_PROPERTY(int reportRate READ reportRate WRITE setReportRate)
     Q_PROPERTY(bool unsavedChanges READ unsavedChanges)
+    Q_PROPERTY(bool verifyWrites READ verifyWrites WRITE setVerifyWrites)
+    Q_PROPERTY(int pipelineDepth READ pipelineDepth WRITE setPipelineDepth)
+    Q_PROPERTY(bool adaptivePacing READ adaptivePacing WRITE setAdaptivePacing)
+    Q_PROPERTY(bool deferredFlags READ deferredFlags WRITE setDeferredFlags)
 
     Q_OBJECT
 
+    enum Notify
+    {
+        NotifyAdvanced = 0x00,
+        NotifyChanged = 0x04,
+    };
+
+public:
     enum Command
     {
         CmdPing,
@@ -51,31 +71,18 @@ class KB390L : public QObject
         CmdFlagGet = 0x80,
     };
 
-    enum Notify
-    {
-        NotifyAdvanced = 0x00,
-        NotifyChanged = 0x04,
-    };
-
-    enum LightOffset
-    {
-        LightTypeOffset = 3,
-        LightDelayOffset,
-        LightBrightnessOffset,
-        LightDirectionOffset = 7,
-    };
+    typedef std::pair<Command, int> PageId;
 
-public:
     enum Constants
     {
         MinMacroNum = 0,
-        MaxMacroNum = 31,
-        MaxReportRate = 3,
-        MaxResponseTime = 10,
-        MaxLightDirection = 4,
-        MaxLightDelay = 10,
-        MaxLightBrightness = 50,
-        ButtonsPerRow = 21,
+        MaxMacroNum = PageLayout::MacroCount - 1,
+        MaxReportRate = PageLayout::ReportRate::maximum,
+        MaxResponseTime = PageLayout::ResponseTime::maximum,
+        MaxLightDirection = PageLayout::LightDirection::maximum,
+        MaxLightDelay = PageLayout::LightDelay::maximum,
+        MaxLightBrightness = PageLayout::LightBrightness::maximum,
+        ButtonsPerRow = PageLayout::EnabledButtons::bitsPerRow,
     };
 
     enum Event
@@ -196,6 +203,18 @@ public:
         KeyPause,
     };
 
+    // All the key bindings and their enabled flags, indexed by KeyIndex.
+    struct ButtonTable
+    {
+        enum
+        {
+            Count = KeyPause + 1,
+        };
+
+        int bindings[Count];
+        bool enabled[Count];
+    };
+
     enum MouseButton
     {
         MouseLeftButton = 0xF0,
@@ -235,8 +254,18 @@ public:
     };
 
     explicit KB390L(QObject *parent = nullptr);
+    // Talk to one of several attached keyboards, see enumerate().
+    explicit KB390L(const QString &path, QObject *parent = nullptr);
+    // Talk to the given devices (e.g. the simulated ones), no hot-plug detection.
+    KB390L(class QHIDDevice *device, class QHIDDevice *eventDevice, QObject *parent = nullptr);
     ~KB390L();
 
+    // The paths of all attached keyboards.
+    static QStringList enumerate();
+    // False if enumerate() is not supported on this platform.
+    static bool canEnumerate();
+    QString path() const;
+
     int flag(Command cmd, int offset = 2);
     void setFlag(Command cmd, int value, int offset = 2);
 
@@ -263,6 +292,30 @@ public:
 
     bool unsavedChanges();
     bool save();
+    // Forget everything read from the device, including the unsaved changes.
+    void invalidateCache();
+
+    // Read the written pages back and rewrite the ones that differ.
+    bool verifyWrites() const;
+    void setVerifyWrites(bool value);
+
+    // Keep the flag changes in the cache until save(), as the pages are,
+    // instead of sending them at once. The flags must be read first.
+    bool deferredFlags() const;
+    void setDeferredFlags(bool value);
+
+    // Opened and not unplugged since, no I/O.
+    bool isConnected() const;
+
+    // Page requests sent before the data of the first one is read, 1 turns the pipelining off.
+    // Whether the firmware queues several requests is not confirmed on all the revisions.
+    int pipelineDepth() const;
+    void setPipelineDepth(int value);
+
+    // Wait for the ping answer after a page write instead of the fixed delay.
+    // Off by default, the answer is not yet confirmed to mean the NAND is written.
+    bool adaptivePacing() const;
+    void setAdaptivePacing(bool value);
 
     int button(KeyIndex btn);
     void setButton(KeyIndex btn, int value);
@@ -270,41 +323,134 @@ public:
     bool buttonEnabled(KeyIndex btn);
     void setButtonEnabled(KeyIndex btn, bool value);
 
+    // The whole table in one pass over the button pages.
+    bool buttonTable(ButtonTable *table);
+    bool setButtonTable(const ButtonTable &table);
+
     QByteArray macro(int index);
+    // The cached macro without copying it, valid until the cache is reloaded.
+    PageView macroView(int index);
     void setMacro(int index, const QByteArray &value);
 
+    // Fetch the pages into the cache, the requests are pipelined if enabled.
+    bool readPages(const std::vector<PageId> &pages);
+
     bool ping();
     bool backupConfig(class QIODevice *storage);
     bool restoreConfig(class QIODevice *storage);
     bool resetToFactoryDefaults();
 
-protected:
-    virtual void timerEvent(QTimerEvent *evt);
+    // Named profiles, stored as the page images in the application data.
+    static QStringList profiles();
+    bool saveProfile(const QString &name);
+    // Writes only the pages which differ from the device, journaled like restoreConfig().
+    bool switchProfile(const QString &name);
+
+    // Asynchronous variants, executed on the I/O thread. All of them return
+    // the request id, the outcome is reported by the finished() signal.
+    // The synchronous calls wait for the running jobs, check isBusy() first.
+    bool isBusy() const;
+    int readPagesAsync(const std::vector<PageId> &pages);
+    int saveAsync();
+    int backupConfigAsync(const QString &fileName);
+    int restoreConfigAsync(const QString &fileName);
+
+    // A restore interrupted by e.g. unplugging the device leaves the pages it
+    // overwrote in a journal, until they are written back or discarded.
+    bool hasUnfinishedRestore() const;
+    bool recoverJournal();
+    int recoverJournalAsync();
+    void discardJournal();
 
 signals:
     void connectChanged(bool connected);
     void genericCommand(int index);
     void changed(KB390L* kb);
+    // Emitted for every page transferred. The requestId is zero for the synchronous calls.
+    void progress(int requestId, int done, int total);
+    void finished(int requestId, bool success);
+    // The device was connected with a journal left behind, see hasUnfinishedRestore().
+    void unfinishedRestore();
 
 private slots:
     void deviceArrival(const QString &path);
-    void deviceRemove();
+    void deviceRemove(const QString &path);
+    void jobDone(int requestId);
+    void eventAvailable();
+    void eventReceived(const QByteArray &evt);
 
 private:
+    struct Job;
+    class IoThread;
+    class EventReader;
+
     QByteArray report(Command b1, char b2 = 0, char b3 = 0, char b4 = 0, char b5 = 0, char b6 = 0, char b7 = 0);
-    QByteArray readPage(Command page, int idx = 0);
+    PageView readPage(Command page, int idx = 0);
+    int requestPage(Command page, int idx);
+    // Valid until the next page is received.
+    PageView receivePage(Command page, int idx, int numBytes);
+    bool flushInput(int numBytes);
     bool writePage(const QByteArray& data, Command page, int idx = 0);
+    // A page or a flag.
+    bool writeEntry(int cacheId, const QByteArray &data);
+
+    // Raw I/O, does not touch the cache, thus can be called from the I/O thread.
+    bool fetchPages(const std::vector<PageId> &pages, std::map<int, QByteArray> *result, int requestId);
+    // Hands each page to the sink as it is received, the view is only valid during the call.
+    bool fetchPages(
+        const std::vector<PageId> &pages, const std::function<void(int, const PageView &)> &sink, int requestId);
+    // The pages which failed the verification are written out as null.
+    bool writePages(const std::map<int, QByteArray> &pages, std::map<int, QByteArray> *written, int requestId);
+    bool verifyPages(const std::map<int, QByteArray> &pages, int requestId);
+    // Transactional: the overwritten pages are journaled to disk and rolled back on failure.
+    bool restorePages(class QIODevice *storage, const std::map<int, QByteArray> &cached,
+        std::map<int, QByteArray> *written, int requestId);
+    // Skips the pages the device already has if changedOnly.
+    bool restorePages(const class Profile &profile, const std::map<int, QByteArray> &cached,
+        std::map<int, QByteArray> *written, int requestId, bool changedOnly);
+    // Raw I/O, see recoverJournal().
+    bool replayJournal(std::map<int, QByteArray> *written, int requestId);
+    // Warns about the unfinished restore, if any.
+    void checkJournal();
+    // The identity of the keyboard the journal is kept for. Empty on Windows
+    // unless the path is given, the journal is not recovered then.
+    QString journalDevice() const;
+    QString journalPath() const;
+    std::map<int, QByteArray> cachedPages(const std::vector<PageId> &pages) const;
+    // As the device has them, without the unsaved changes.
+    std::map<int, QByteArray> devicePages(const std::vector<PageId> &pages) const;
+    std::vector<PageId> missingPages(const std::vector<PageId> &pages) const;
+    std::map<int, QByteArray> modifiedPages() const;
+    void postJob(Job *job, const std::function<bool()> &fn);
+    // Store or commit the written pages, the unverified ones are invalidated.
+    void cacheWritten(const std::map<int, QByteArray> &written, bool replace);
 
     int readByte(Command page, int offset);
     void writeByte(Command page, int offset, int value);
+    // The cache slot of the page, loaded from the device if needed; -1 on failure.
+    int loadPage(Command page, int idx = 0);
 
+    QString devicePath;
     class QHIDDevice *device;
     class QHIDDevice *eventDevice;
     class QHIDMonitor *monitor;
-    int timerId;
-
-    std::map<int, QByteArray> cache;
-    std::map<int, bool> dirtyPages;
+    EventReader *eventReader;
+    // Not unplugged since it was opened.
+    bool online;
+
+    // Serializes the device access between the I/O thread and the callers.
+    QMutex ioMutex;
+    // Reused by every transfer, guarded by ioMutex.
+    QByteArray reportBuffer;
+    QByteArray rxBuffer;
+    IoThread *ioThread;
+    int lastRequestId;
+    std::map<int, Job *> jobs;
+    bool verify;
+    bool deferFlags;
+    int pipeline;
+
+    PageCache cache;
 };
 
 #endif // KB390L_H
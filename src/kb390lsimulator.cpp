@@ -0,0 +1,421 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "kb390lsimulator.h"
+#include "pagelayout.h"
+#include "qhidtransport.h"
+
+#include <QThread>
+
+#include <climits>
+
+#define PAGE_SIZE   PageLayout::PageSize
+#define REPORT_SIZE PageLayout::ReportSize
+#define MACRO_COUNT PageLayout::MacroCount
+
+// Firmware commands, must match KB390L::Command
+enum
+{
+    CmdPing,
+    CmdReportRate,
+    CmdResponseTime = 4,
+    CmdControl = 8,
+    CmdGameMode = 9,
+    CmdButtons = 0x0D,
+    CmdEnabledButtons = 0x0E,
+    CmdMacro = 0x11,
+    CmdReset = 0x13,
+    CmdFlagGet = 0x80,
+};
+
+enum
+{
+    NotifyAdvanced = 0x00,
+    NotifyChanged = 0x04,
+};
+
+static char crc(const char *data, int length)
+{
+    char sum = -1;
+
+    for (int i = 0; i < length; ++i)
+    {
+        sum -= data[i];
+    }
+
+    return sum;
+}
+
+class KB390LSimulator::GenericTransport : public QHIDTransport
+{
+public:
+    explicit GenericTransport(KB390LSimulator *sim)
+        : sim(sim)
+    {
+    }
+
+    bool isValid() const override
+    {
+        return sim->isConnected();
+    }
+
+    int sendFeatureReport(const char *buffer, int length) override
+    {
+        return sim->sendFeatureReport(buffer, length);
+    }
+
+    int getFeatureReport(char *buffer, int length) override
+    {
+        return sim->getFeatureReport(buffer, length);
+    }
+
+    int write(const char *buffer, int length) override
+    {
+        return sim->write(buffer, length);
+    }
+
+    int read(char *buffer, int length, int timeout) override
+    {
+        return sim->read(sim->interruptQueue, buffer, length, timeout);
+    }
+
+private:
+    KB390LSimulator *sim;
+};
+
+class KB390LSimulator::EventTransport : public QHIDTransport
+{
+public:
+    explicit EventTransport(KB390LSimulator *sim)
+        : sim(sim)
+    {
+    }
+
+    bool isValid() const override
+    {
+        return sim->isConnected();
+    }
+
+    int sendFeatureReport(const char *, int) override
+    {
+        return -1;
+    }
+
+    int getFeatureReport(char *, int) override
+    {
+        return -1;
+    }
+
+    int write(const char *, int) override
+    {
+        return -1;
+    }
+
+    int read(char *buffer, int length, int timeout) override
+    {
+        return sim->read(sim->eventQueue, buffer, length, timeout);
+    }
+
+private:
+    KB390LSimulator *sim;
+};
+
+KB390LSimulator::KB390LSimulator()
+    : generic(new GenericTransport(this))
+    , events(new EventTransport(this))
+    , latencyValue(0)
+    , connected(true)
+    , writeTarget(nullptr)
+    , writeOffset(0)
+    , writeLength(0)
+    , transfers(0)
+    , bytes(0)
+{
+    resetToFactoryDefaults();
+}
+
+KB390LSimulator::~KB390LSimulator()
+{
+    delete generic;
+    delete events;
+}
+
+QHIDTransport *KB390LSimulator::genericTransport()
+{
+    return generic;
+}
+
+QHIDTransport *KB390LSimulator::eventTransport()
+{
+    return events;
+}
+
+int KB390LSimulator::latency() const
+{
+    QMutexLocker lock(&mutex);
+    return latencyValue;
+}
+
+void KB390LSimulator::setLatency(int usecs)
+{
+    QMutexLocker lock(&mutex);
+    latencyValue = usecs;
+}
+
+bool KB390LSimulator::isConnected() const
+{
+    QMutexLocker lock(&mutex);
+    return connected;
+}
+
+void KB390LSimulator::setConnected(bool value)
+{
+    QMutexLocker lock(&mutex);
+    connected = value;
+    interruptQueue.clear();
+    eventQueue.clear();
+    writeTarget = nullptr;
+    dataAvailable.wakeAll();
+}
+
+void KB390LSimulator::changeFlag(int cmd, int offset, int value)
+{
+    {
+        QMutexLocker lock(&mutex);
+        auto iter = flags.find(cmd);
+        if (iter == flags.end() || offset < 2 || offset >= REPORT_SIZE - 1)
+            return;
+
+        iter->second[offset - 2] = char(value);
+    }
+
+    notify(NotifyChanged);
+}
+
+void KB390LSimulator::notify(int type, int arg)
+{
+    QByteArray evt(4, '\x0');
+    evt[0] = 4;
+    evt[1] = char(type);
+    evt[2] = char(arg);
+
+    QMutexLocker lock(&mutex);
+    eventQueue.enqueue(evt);
+    dataAvailable.wakeAll();
+}
+
+void KB390LSimulator::resetToFactoryDefaults()
+{
+    QMutexLocker lock(&mutex);
+
+    // Flags are stored without the command byte, i.e. starting from offset 2.
+    flags[CmdPing] = QByteArray(6, '\x0');
+    flags[CmdReportRate] = QByteArray("\x03\x00\x00\x00\x00\x00", 6);
+    flags[CmdResponseTime] = QByteArray("\x02\x00\x00\x00\x00\x00", 6);
+    // type = wave, delay = 5, brightness = 50, direction = right
+    flags[CmdControl] = QByteArray("\x00\x03\x05\x32\x00\x01", 6);
+    flags[CmdGameMode] = QByteArray(6, '\x0');
+
+    buttons = QByteArray(PageLayout::ButtonsSize, '\x0');
+    enabledButtons = QByteArray(PageLayout::EnabledButtonsSize, '\xFF');
+    for (int i = 0; i < MACRO_COUNT; ++i)
+    {
+        macros[i] = QByteArray(PageLayout::MacroSize, '\x0');
+    }
+}
+
+QByteArray KB390LSimulator::page(int cmd, int idx) const
+{
+    QMutexLocker lock(&mutex);
+    auto data = const_cast<KB390LSimulator *>(this)->pageData(cmd, idx);
+    return data ? *data : QByteArray();
+}
+
+int KB390LSimulator::transferCount() const
+{
+    QMutexLocker lock(&mutex);
+    return transfers;
+}
+
+qint64 KB390LSimulator::byteCount() const
+{
+    QMutexLocker lock(&mutex);
+    return bytes;
+}
+
+void KB390LSimulator::resetCounters()
+{
+    QMutexLocker lock(&mutex);
+    transfers = 0;
+    bytes = 0;
+}
+
+QByteArray *KB390LSimulator::pageData(int cmd, int idx)
+{
+    switch (cmd)
+    {
+    case CmdButtons:
+        return &buttons;
+    case CmdEnabledButtons:
+        return &enabledButtons;
+    case CmdMacro:
+        return idx >= 0 && idx < MACRO_COUNT ? &macros[idx] : nullptr;
+    }
+
+    return nullptr;
+}
+
+void KB390LSimulator::transferDone(int length)
+{
+    int usecs;
+    {
+        QMutexLocker lock(&mutex);
+        ++transfers;
+        bytes += length;
+        usecs = latencyValue;
+    }
+
+    if (usecs > 0)
+        QThread::usleep(ulong(usecs));
+}
+
+int KB390LSimulator::sendFeatureReport(const char *buffer, int length)
+{
+    {
+        QMutexLocker lock(&mutex);
+
+        if (!connected || length < REPORT_SIZE || buffer[REPORT_SIZE - 1] != crc(buffer, REPORT_SIZE - 1))
+            return -1;
+
+        int cmd = 0xFF & buffer[1];
+        int idx = 0xFF & buffer[3];
+        response = QByteArray(buffer, REPORT_SIZE);
+
+        if (cmd & CmdFlagGet)
+        {
+            auto data = pageData(cmd & ~CmdFlagGet, idx);
+            auto iter = flags.find(cmd & ~CmdFlagGet);
+
+            if (data)
+            {
+                // The page follows via the interrupt endpoint.
+                int numPages = data->length() / PAGE_SIZE;
+                response[4] = char(numPages);
+                for (int i = 0; i < numPages; ++i)
+                {
+                    interruptQueue.enqueue(data->mid(i * PAGE_SIZE, PAGE_SIZE));
+                }
+                dataAvailable.wakeAll();
+            }
+            else if (iter != flags.end())
+            {
+                response.replace(2, iter->second.length(), iter->second);
+            }
+        }
+        else if (cmd == CmdReset)
+        {
+            lock.unlock();
+            resetToFactoryDefaults();
+        }
+        else
+        {
+            auto data = pageData(cmd, idx);
+            auto iter = flags.find(cmd);
+
+            if (data)
+            {
+                // The page follows via the interrupt endpoint.
+                writeTarget = data;
+                writeOffset = 0;
+                writeLength = cmd == CmdEnabledButtons ? PAGE_SIZE : (0xFF & buffer[4]) * PAGE_SIZE;
+                writeLength = qMin(writeLength, data->length());
+            }
+            else if (iter != flags.end())
+            {
+                iter->second = QByteArray(buffer + 2, iter->second.length());
+            }
+        }
+    }
+
+    transferDone(length);
+    return length;
+}
+
+int KB390LSimulator::getFeatureReport(char *buffer, int length)
+{
+    {
+        QMutexLocker lock(&mutex);
+
+        if (!connected || response.isEmpty())
+            return -1;
+
+        response[REPORT_SIZE - 1] = crc(response.constData(), REPORT_SIZE - 1);
+        length = qMin(length, response.length());
+        memcpy(buffer, response.constData(), size_t(length));
+    }
+
+    transferDone(length);
+    return length;
+}
+
+int KB390LSimulator::write(const char *buffer, int length)
+{
+    {
+        QMutexLocker lock(&mutex);
+
+        // The first byte is the report number.
+        if (!connected || !writeTarget || length < 2)
+            return -1;
+
+        auto size = qMin(length - 1, writeLength - writeOffset);
+        writeTarget->replace(writeOffset, size, buffer + 1, size);
+        writeOffset += size;
+
+        if (writeOffset >= writeLength)
+            writeTarget = nullptr;
+    }
+
+    transferDone(length);
+    return length;
+}
+
+int KB390LSimulator::read(QQueue<QByteArray> &queue, char *buffer, int length, int timeout)
+{
+    {
+        QMutexLocker lock(&mutex);
+
+        while (connected && queue.isEmpty())
+        {
+            if (!dataAvailable.wait(&mutex, timeout < 0 ? ULONG_MAX : ulong(timeout)))
+            {
+                // Timed out, as hidapi does
+                return 0;
+            }
+        }
+
+        if (!connected)
+            return -1;
+
+        auto packet = queue.dequeue();
+        length = qMin(length, packet.length());
+        memcpy(buffer, packet.constData(), size_t(length));
+    }
+
+    transferDone(length);
+    return length;
+}
@@ -0,0 +1,106 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef KB390LSIMULATOR_H
+#define KB390LSIMULATOR_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+
+#include <map>
+
+class QHIDTransport;
+
+// In-process emulation of the KB390L firmware.
+// Provides two transports: the generic one (usage page 0xFF01) which serves
+// the feature reports & page transfers, and the event one (usage page 0xFF02)
+// which delivers the notifications. All methods are thread safe.
+class KB390LSimulator
+{
+public:
+    KB390LSimulator();
+    ~KB390LSimulator();
+
+    QHIDTransport *genericTransport();
+    QHIDTransport *eventTransport();
+
+    // Emulated duration of every single transfer, in microseconds.
+    int latency() const;
+    void setLatency(int usecs);
+
+    // Unplugged device fails all the transfers.
+    bool isConnected() const;
+    void setConnected(bool value);
+
+    // Emulate a change made on the keyboard itself (e.g. Fn+Light),
+    // the device sends NotifyChanged afterwards.
+    void changeFlag(int cmd, int offset, int value);
+    // Send an arbitrary notification via the event interface.
+    void notify(int type, int arg = 0);
+
+    void resetToFactoryDefaults();
+
+    // Raw access to the emulated NAND.
+    QByteArray page(int cmd, int idx = 0) const;
+
+    // Transfer counters.
+    int transferCount() const;
+    qint64 byteCount() const;
+    void resetCounters();
+
+private:
+    class GenericTransport;
+    class EventTransport;
+
+    int sendFeatureReport(const char *buffer, int length);
+    int getFeatureReport(char *buffer, int length);
+    int write(const char *buffer, int length);
+    int read(QQueue<QByteArray> &queue, char *buffer, int length, int timeout);
+
+    QByteArray *pageData(int cmd, int idx);
+    void transferDone(int bytes);
+
+    GenericTransport *generic;
+    EventTransport *events;
+
+    mutable QMutex mutex;
+    QWaitCondition dataAvailable;
+    int latencyValue;
+    bool connected;
+
+    QByteArray response;
+    QQueue<QByteArray> interruptQueue;
+    QQueue<QByteArray> eventQueue;
+
+    // The page being written by the host.
+    QByteArray *writeTarget;
+    int writeOffset;
+    int writeLength;
+
+    std::map<int, QByteArray> flags;
+    QByteArray buttons;
+    QByteArray enabledButtons;
+    QByteArray macros[32];
+
+    int transfers;
+    qint64 bytes;
+};
+
+#endif // KB390LSIMULATOR_H
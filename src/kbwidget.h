@@ -19,8 +19,12 @@
 #ifndef kbWIDGET_H
 #define kbWIDGET_H
 
+#include "kb390l.h"
+
 #include <QWidget>
 
+#include <vector>
+
 class KbWidget : public QWidget
 {
     Q_OBJECT
@@ -31,6 +35,8 @@ public:
     {
     }
 
+    // The pages load() reads, to fetch them in the background beforehand.
+    virtual std::vector<KB390L::PageId> pages() const = 0;
     virtual bool load(class KB390L *) = 0;
     virtual void save(class KB390L *) = 0;
 };
@@ -17,25 +17,252 @@
  */
 
 #include "mainwindow.h"
+#include "commandinterpreter.h"
+#include "daemon.h"
 #include "kb390l.h"
+#include "qhidstats.h"
 
 #include <QApplication>
 #include <QCommandLineParser>
 #include <QDebug>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QRegExp>
+#include <QScopedPointer>
 #include <QThread>
 
+#include <stdio.h>
+#include <string.h>
+
 inline QString tr(const char *str)
 {
     return QCoreApplication::translate("main", str);
 }
 
+// Prefix the messages with the keyboard path when there are several of them.
+static QDebug out(const QString &id)
+{
+    auto dbg = qWarning();
+    if (!id.isEmpty())
+    {
+        dbg << qPrintable(id + ":");
+    }
+    return dbg;
+}
+
+// A backup per keyboard: config.bin => config-1-2.bin
+static QString fileName(const QString &name, const QString &id)
+{
+    if (id.isEmpty())
+    {
+        return name;
+    }
+
+    QFileInfo fi(name);
+    auto suffix = fi.suffix().isEmpty() ? QString() : "." + fi.suffix();
+    auto tag = QString(id).replace(QRegExp("[^\\w.-]"), "_");
+    return fi.dir().filePath(fi.completeBaseName() + "-" + tag + suffix);
+}
+
+// The commands writing a file get a file per keyboard, the keyboards run at once.
+static QString deviceCommand(const QString &command, const QString &id)
+{
+    auto cmd = command.section(' ', 0, 0);
+    auto arg = command.section(' ', 1).trimmed();
+
+    if (id.isEmpty() || arg.isEmpty())
+        return command;
+
+    if (cmd == "backup")
+        return cmd + " " + fileName(arg, id);
+
+    if (cmd == "save-profile")
+        return cmd + " " + arg + "-" + QString(id).replace(QRegExp("[^\\w.-]"), "_");
+
+    return command;
+}
+
+// The command line options as the interpreter commands, in the order given.
+static QStringList optionCommands(const QCommandLineParser &parser, const QString &id)
+{
+    static const struct
+    {
+        const char *shortName;
+        const char *name;
+        const char *command;
+    } options[] = {
+        {"g", "game-mode", "get game-mode"},
+        {"G", "set-game-mode", "set game-mode"},
+        {"r", "rate", "get rate"},
+        {"R", "set-rate", "set rate"},
+        {"t", "response-time", "get response-time"},
+        {"T", "set-response-time", "set response-time"},
+        {"", "backup", "backup"},
+        {"", "restore", "restore"},
+        {"", "recover", "recover"},
+        {"", "reset", "reset"},
+        {"", "profiles", "profiles"},
+        {"", "save-profile", "save-profile"},
+        {"", "switch-profile", "switch-profile"},
+    };
+
+    QStringList commands;
+    // The option may be repeated, each time with its own value.
+    QHash<QString, int> used;
+
+    foreach (auto name, parser.optionNames())
+    {
+        foreach (const auto &option, options)
+        {
+            if (name != option.shortName && name != option.name)
+                continue;
+
+            QString command(option.command);
+            auto values = parser.values(option.name);
+            if (!values.isEmpty())
+            {
+                auto value = values.value(used[option.name]++);
+                command += " " + value;
+            }
+
+            commands.append(deviceCommand(command, id));
+            break;
+        }
+    }
+
+    return commands;
+}
+
+// Read the batch file, "-" for the standard input.
+static bool readCommands(const QString &name, QStringList *commands)
+{
+    QFile file(name);
+    auto ok = name == "-" ? file.open(stdin, QFile::ReadOnly | QFile::Text) : file.open(QFile::ReadOnly | QFile::Text);
+
+    if (!ok)
+    {
+        qWarning() << "Failed to open" << name << "for reading.";
+        return false;
+    }
+
+    while (!file.atEnd())
+    {
+        auto line = QString::fromUtf8(file.readLine()).trimmed();
+
+        if (!line.isEmpty() && !line.startsWith('#'))
+            commands->append(line);
+    }
+
+    return true;
+}
+
+// Run all the commands in a single session, the device is opened once and
+// the flags read by one command are served from the cache for the next ones.
+static int runCommands(KB390L &kb, const QStringList &commands, const QString &id)
+{
+    // For any command we need the device, so check it in advance.
+    if (!kb.ping())
+    {
+        out(id) << "The device was not found.";
+        return 1;
+    }
+
+    if (kb.hasUnfinishedRestore() && !commands.contains("recover"))
+    {
+        out(id) << "The last restore was interrupted, run with --recover to roll it back.";
+    }
+
+    CommandInterpreter interpreter(&kb);
+
+    foreach (auto command, commands)
+    {
+        auto reply = interpreter.execute(command);
+
+        if (reply.startsWith("error"))
+        {
+            out(id) << qPrintable(command + ": " + reply.mid(6));
+            return reply.contains("failed to open") ? 2 : 3;
+        }
+
+        // Print the values only.
+        if (reply.length() > 3)
+            out(id) << qPrintable(reply.mid(3));
+    }
+
+    return 0;
+}
+
+class Worker : public QThread
+{
+public:
+    Worker(KB390L *kb, const QStringList &commands)
+        : kb(kb)
+        , commands(commands)
+        , result(-1)
+    {
+    }
+
+    ~Worker()
+    {
+        delete kb;
+    }
+
+    KB390L *kb;
+    QStringList commands;
+    int result;
+
+protected:
+    void run() override
+    {
+        result = runCommands(*kb, commands, kb->path());
+    }
+};
+
+// Prints the I/O summary on the way out, whatever the mode was.
+class StatsReport
+{
+public:
+    explicit StatsReport(bool enabled)
+        : enabled(enabled)
+    {
+    }
+
+    ~StatsReport()
+    {
+        if (enabled)
+            fputs(qPrintable(QHIDStats::instance()->summary()), stderr);
+    }
+
+private:
+    bool enabled;
+};
+
+// Checked before the command line is parsed, since the parser needs the application.
+static bool isDaemon(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--daemon") == 0)
+            return true;
+    }
+
+    return false;
+}
+
 int main(int argc, char *argv[])
 {
-    QApplication app(argc, argv);
+    // The daemon runs without a display.
+    QScopedPointer<QCoreApplication> app(
+        isDaemon(argc, argv) ? new QCoreApplication(argc, argv) : new QApplication(argc, argv));
     QCoreApplication::setApplicationName(PRODUCT_NAME);
     QCoreApplication::setApplicationVersion(PRODUCT_VERSION);
-    app.setWindowIcon(QIcon(":/app/icon"));
+
+    if (qobject_cast<QApplication *>(app.data()))
+    {
+        QApplication::setWindowIcon(QIcon(":/app/icon"));
+    }
 
     QCommandLineParser parser;
     parser.setApplicationDescription(tr("HV-KB390L configuration application"));
@@ -60,124 +287,146 @@ int main(int argc, char *argv[])
     parser.addOption(resetOption);
     QCommandLineOption restoreOption(QStringList() << "restore", tr("Restore NAND data from a <file>."), tr("file"));
     parser.addOption(restoreOption);
+    QCommandLineOption recoverOption(
+        QStringList() << "recover", tr("Roll back the interrupted restore to the previous config."));
+    parser.addOption(recoverOption);
+    QCommandLineOption profilesOption(QStringList() << "profiles", tr("List the saved profiles."));
+    parser.addOption(profilesOption);
+    QCommandLineOption saveProfileOption(
+        QStringList() << "save-profile", tr("Save the device config as a profile <name>."), tr("name"));
+    parser.addOption(saveProfileOption);
+    QCommandLineOption switchProfileOption(
+        QStringList() << "switch-profile", tr("Switch to the profile <name>."), tr("name"));
+    parser.addOption(switchProfileOption);
+    QCommandLineOption verifyOption(QStringList() << "verify", tr("Read the written data back and check it."));
+    parser.addOption(verifyOption);
     QCommandLineOption verboseOption(QStringList() << "verbose", tr("Verbose output."));
     parser.addOption(verboseOption);
+    QCommandLineOption statsOption(QStringList() << "stats", tr("Print the I/O latency summary on exit."));
+    parser.addOption(statsOption);
+    QCommandLineOption traceOption(
+        QStringList() << "trace", tr("Record every I/O call to a binary trace <file>."), tr("file"));
+    parser.addOption(traceOption);
+    QCommandLineOption listOption(QStringList() << "l" << "list", tr("List the attached keyboards."));
+    parser.addOption(listOption);
+    QCommandLineOption deviceOption(QStringList() << "d" << "device", tr("Select the keyboard by its <path>."), tr("path"));
+    parser.addOption(deviceOption);
+    QCommandLineOption allOption(QStringList() << "a" << "all", tr("Apply the command to all attached keyboards."));
+    parser.addOption(allOption);
+
+    QCommandLineOption execOption(
+        QStringList() << "x" << "exec", tr("Execute the commands from a <file>, - for stdin."), tr("file"));
+    parser.addOption(execOption);
+    QCommandLineOption daemonOption(QStringList() << "daemon", tr("Serve the commands over a local socket."));
+    parser.addOption(daemonOption);
+    QCommandLineOption socketOption(
+        QStringList() << "socket", tr("The socket <name> for the daemon."), tr("name"), PRODUCT_NAME);
+    parser.addOption(socketOption);
 
     // Process the actual command line arguments given by the user.
-    parser.process(app);
+    parser.process(*app);
 
     if (!parser.isSet(verboseOption))
     {
         QLoggingCategory::setFilterRules("*.debug=false");
     }
 
+    if (parser.isSet(traceOption) && !QHIDStats::instance()->startTrace(parser.value(traceOption)))
+    {
+        return 2;
+    }
+
+    StatsReport stats(parser.isSet(statsOption));
+
     auto optionsNames = parser.optionNames();
     optionsNames.removeAll("verbose");
+    optionsNames.removeAll("stats");
+    optionsNames.removeAll("trace");
+    optionsNames.removeAll("verify");
+    optionsNames.removeAll("d");
+    optionsNames.removeAll("device");
 
     if (optionsNames.isEmpty())
     {
-        MainWindow w;
+        MainWindow w(parser.value(deviceOption));
         w.show();
-        return app.exec();
-    }
-
-    KB390L kb;
-
-    // For any other command line option we need the device, so check it in advance.
-    if (!kb.ping())
-    {
-        qWarning() << "The device was not found.";
-        return 1;
+        return app->exec();
     }
 
-    if (parser.isSet(backupOption))
+    if (parser.isSet(daemonOption))
     {
-        qWarning() << "Reading config from the device...";
-
-        QFile file(parser.value(backupOption));
-
-        if (!file.open(QFile::WriteOnly))
-        {
-            qWarning() << "Failed to open" << file.fileName() << "for writing.";
-            return 2;
-        }
+        KB390L kb(parser.value(deviceOption));
+        kb.setVerifyWrites(parser.isSet(verifyOption));
 
-        if (!kb.backupConfig(&file))
-        {
-            qWarning() << "Failed to read the config.";
-            return 3;
-        }
+        Daemon daemon(&kb);
+        if (!daemon.listen(parser.value(socketOption)))
+            return 1;
 
-        qWarning() << "The config has been successfully read from the device and written to" << file.fileName();
-        return 0;
+        qWarning() << "Listening on" << daemon.serverName();
+        return app->exec();
     }
 
-    if (parser.isSet(restoreOption))
+    if ((parser.isSet(listOption) || parser.isSet(allOption)) && !KB390L::canEnumerate())
     {
-        qWarning() << "Writing config to the device...";
-
-        QFile file(parser.value(restoreOption));
+        qWarning() << "Listing the keyboards is not supported on this platform.";
+        return 2;
+    }
 
-        if (!file.open(QFile::ReadOnly))
-        {
-            qWarning() << "Failed to open" << file.fileName() << "for reading.";
-            return 2;
-        }
+    auto paths = KB390L::enumerate();
 
-        if (!kb.restoreConfig(&file))
+    if (parser.isSet(listOption))
+    {
+        foreach (auto path, paths)
         {
-            qWarning() << "Failed to write the config.";
-            return 3;
+            qWarning() << qPrintable(path);
         }
-
-        qWarning() << "The config has been successfully read from " << file.fileName() << " and written to the device";
-        return 0;
-    }
-
-    if (parser.isSet(resetOption))
-    {
-        kb.resetToFactoryDefaults();
-        return 0;
+        return paths.isEmpty() ? 1 : 0;
     }
 
-    if (parser.isSet(setGameModeOption))
+    QStringList batch;
+    if (parser.isSet(execOption) && !readCommands(parser.value(execOption), &batch))
     {
-        kb.setGameMode(!!parser.value(setGameModeOption).compare("off", Qt::CaseInsensitive));
-        return 0;
+        return 2;
     }
 
-    if (parser.isSet(gameModeOption))
+    if (!parser.isSet(allOption))
     {
-        auto mode = kb.gameMode();
-        qWarning() << (mode == 1 ? "on" : mode == 0 ? "off" : "error");
-        return 0;
+        KB390L kb(parser.value(deviceOption));
+        kb.setVerifyWrites(parser.isSet(verifyOption));
+        return runCommands(kb, optionCommands(parser, QString()) + batch, QString());
     }
 
-    if (parser.isSet(rateOption))
+    if (paths.isEmpty())
     {
-        qWarning() << kb.reportRate();
-        return 0;
+        qWarning() << "The device was not found.";
+        return 1;
     }
 
-    if (parser.isSet(setRateOption))
+    // Every keyboard gets its own worker, so N keyboards take as long as one.
+    QList<Worker *> workers;
+    foreach (auto path, paths)
     {
-        kb.setReportRate(parser.value(setRateOption).toInt());
-        return 0;
-    }
+        auto kb = new KB390L(path);
+        kb->setVerifyWrites(parser.isSet(verifyOption));
+        QStringList commands = optionCommands(parser, path);
+        foreach (auto command, batch)
+        {
+            commands.append(deviceCommand(command.trimmed(), path));
+        }
 
-    if (parser.isSet(responseTimeOption))
-    {
-        qWarning() << kb.responseTime() * 2;
-        return 0;
+        auto worker = new Worker(kb, commands);
+        workers.append(worker);
+        worker->start();
     }
 
-    if (parser.isSet(setResponseTimeOption))
+    int ret = 0;
+    foreach (auto worker, workers)
     {
-        kb.setResponseTime(parser.value(setResponseTimeOption).toInt() / 2);
-        return 0;
+        worker->wait();
+        out(worker->kb->path()) << (worker->result == 0 ? "done" : "failed");
+        ret = qMax(ret, worker->result);
+        delete worker;
     }
 
-    // Should never happen.
-    qCritical() << "Unhandled options: " << parser.optionNames();
-    return 0;
+    return ret;
 }
@@ -26,7 +26,9 @@
 #include "pagespeed.h"
 
 #include <QCloseEvent>
+#include <QLabel>
 #include <QMessageBox>
+#include <QStatusBar>
 #include <QStyle>
 
 static void initAction(QAction *action, QStyle::StandardPixmap icon, QKeySequence::StandardKey key)
@@ -36,12 +38,17 @@ static void initAction(QAction *action, QStyle::StandardPixmap icon, QKeySequenc
     action->setToolTip(action->shortcut().toString(QKeySequence::NativeText));
 }
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(const QString &devicePath, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
-    , kb(new KB390L(this))
+    , kb(new KB390L(devicePath, this))
+    , saveRequestId(0)
+    , closeAfterSave(false)
+    , recoverRequestId(0)
 {
     ui->setupUi(this);
+    // The flags are written with the rest of the pages on save, not from the UI thread.
+    kb->setDeferredFlags(true);
     // The Designer really lacs this functionality
     initAction(ui->actionExit, QStyle::SP_DialogCloseButton, QKeySequence::Quit);
     initAction(ui->actionSave, QStyle::SP_DialogSaveButton, QKeySequence::Save);
@@ -49,9 +56,16 @@ MainWindow::MainWindow(QWidget *parent)
     ui->labelText->setText(ui->labelText->text().arg(PRODUCT_VERSION).arg(__DATE__));
     connect(kb, SIGNAL(connectChanged(bool)), this, SLOT(onkbConnected(bool)));
     connect(kb, SIGNAL(buttonsPressed(int)), this, SLOT(onButtonsPressed(int)));
+    connect(kb, SIGNAL(progress(int,int,int)), this, SLOT(onkbProgress(int,int,int)));
+    connect(kb, SIGNAL(finished(int,bool)), this, SLOT(onkbFinished(int,bool)));
+    connect(kb, SIGNAL(unfinishedRestore()), this, SLOT(onkbUnfinishedRestore()), Qt::QueuedConnection);
 
-    // Check the device availability
-    onkbConnected(kb->ping());
+    // The device is opened on the I/O thread, connectChanged follows.
+    onkbConnected(kb->isConnected());
+
+    // Ask once the window is shown.
+    if (kb->hasUnfinishedRestore())
+        QMetaObject::invokeMethod(this, "onkbUnfinishedRestore", Qt::QueuedConnection);
 }
 
 MainWindow::~MainWindow()
@@ -61,11 +75,20 @@ MainWindow::~MainWindow()
 
 void MainWindow::updatekb()
 {
-    foreach (auto edit, findChildren<ButtonEdit *>())
+    // Only the pages opened so far have the editors, keep the rest of the table as is.
+    KB390L::ButtonTable table;
+    auto edits = findChildren<ButtonEdit *>();
+
+    if (!edits.isEmpty() && kb->buttonTable(&table))
     {
-        auto index = KB390L::KeyIndex(edit->property("ButtonIndex").toInt());
-        kb->setButton(index, edit->value());
-        kb->setButtonEnabled(index, edit->buttonEnabled());
+        foreach (auto edit, edits)
+        {
+            auto index = edit->property("ButtonIndex").toInt();
+            table.bindings[index] = edit->value();
+            table.enabled[index] = edit->buttonEnabled();
+        }
+
+        kb->setButtonTable(table);
     }
 
     foreach (auto widget, findChildren<KbWidget *>())
@@ -76,12 +99,87 @@ void MainWindow::updatekb()
 
 void MainWindow::onSave()
 {
+    if (saveRequestId)
+    {
+        // Already saving
+        return;
+    }
+
     updatekb();
 
-    if (!kb->save())
+    // The pages are written on the I/O thread, keep the UI responsive meanwhile.
+    saveRequestId = kb->saveAsync();
+    ui->actionSave->setEnabled(false);
+    statusBar()->showMessage(tr("Saving..."));
+}
+
+void MainWindow::onkbProgress(int requestId, int done, int total)
+{
+    if (requestId && requestId == saveRequestId)
+    {
+        statusBar()->showMessage(tr("Saving... %1 of %2").arg(done).arg(total));
+    }
+}
+
+void MainWindow::onkbFinished(int requestId, bool success)
+{
+    if (pageRequests.contains(requestId))
+    {
+        auto request = pageRequests.take(requestId);
+        buildPage(request.first, request.second, success);
+        return;
+    }
+
+    if (requestId && requestId == recoverRequestId)
+    {
+        recoverRequestId = 0;
+        statusBar()->clearMessage();
+        resetPages();
+        onPreparePage(ui->tabWidget->currentIndex());
+
+        if (!success)
+            QMessageBox::warning(this, windowTitle(), tr("Failed to roll back the keyboard config"));
+        return;
+    }
+
+    if (requestId != saveRequestId)
+        return;
+
+    saveRequestId = 0;
+    ui->actionSave->setEnabled(true);
+    statusBar()->clearMessage();
+
+    if (!success)
     {
+        closeAfterSave = false;
         QMessageBox::warning(this, windowTitle(), tr("Failed to save"));
     }
+    else if (closeAfterSave)
+    {
+        close();
+    }
+}
+
+void MainWindow::onkbUnfinishedRestore()
+{
+    if (!kb->hasUnfinishedRestore())
+        return;
+
+    auto answer = QMessageBox::question(this, windowTitle(),
+        tr("The last restore of the keyboard config was interrupted.\n"
+           "Roll the keyboard back to the config it had before?\n"
+           "Discard forgets the previous config."),
+        QMessageBox::Yes | QMessageBox::No | QMessageBox::Discard);
+
+    if (answer == QMessageBox::Discard)
+    {
+        kb->discardJournal();
+    }
+    else if (answer == QMessageBox::Yes && !recoverRequestId)
+    {
+        recoverRequestId = kb->recoverJournalAsync();
+        statusBar()->showMessage(tr("Rolling back..."));
+    }
 }
 
 void MainWindow::onkbConnected(bool connected)
@@ -90,6 +188,9 @@ void MainWindow::onkbConnected(bool connected)
     if (!connected)
         ui->tabWidget->setCurrentIndex(aboutIndex);
 
+    // The pages shown so far belong to the previous device, if any.
+    resetPages();
+
     for (int i = 0; i < ui->tabWidget->count(); ++i)
     {
         if (aboutIndex == i)
@@ -98,6 +199,9 @@ void MainWindow::onkbConnected(bool connected)
     }
 
     ui->actionSave->setEnabled(connected);
+
+    if (connected)
+        onPreparePage(ui->tabWidget->currentIndex());
 }
 
 static std::pair<QString, KB390L::KeyIndex> buttons[][KB390L::ButtonsPerRow] =
@@ -213,6 +317,11 @@ static std::pair<QString, KB390L::KeyIndex> buttons[][KB390L::ButtonsPerRow] =
 static bool prepareButtonsPage(
     QWidget *parent, KB390L *kb, const std::pair<QString, KB390L::KeyIndex> *buttons)
 {
+    // Both pages are in the cache by now, decoded in a single pass.
+    KB390L::ButtonTable table;
+    if (!kb->buttonTable(&table))
+        return false;
+
     auto layout = new QVBoxLayout;
 
     for (size_t i = 0; i < KB390L::ButtonsPerRow; ++i)
@@ -220,16 +329,11 @@ static bool prepareButtonsPage(
         if (buttons[i].first.isNull())
             break;
 
-        auto value = kb->button(buttons[i].second);
-        if (value == -1)
-        {
-            delete layout;
-            return false;
-        }
+        auto index = buttons[i].second;
         auto edit = new ButtonEdit(buttons[i].first);
-        edit->setProperty("ButtonIndex", buttons[i].second);
-        edit->setValue(value);
-        edit->setButtonEnabled(kb->buttonEnabled(buttons[i].second));
+        edit->setProperty("ButtonIndex", index);
+        edit->setValue(table.bindings[index]);
+        edit->setButtonEnabled(table.enabled[index]);
         layout->addWidget(edit);
     }
 
@@ -252,38 +356,95 @@ bool MainWindow::initPage(QWidget *parent, KbWidget *page)
     return true;
 }
 
+static void clearPage(QWidget *parent)
+{
+    delete parent->layout();
+
+    foreach (auto child, parent->findChildren<QWidget *>(QString(), Qt::FindDirectChildrenOnly))
+    {
+        delete child;
+    }
+}
+
+void MainWindow::resetPages()
+{
+    foreach (auto request, pageRequests)
+    {
+        delete request.second;
+    }
+    pageRequests.clear();
+
+    for (int i = 0; i < ui->tabWidget->count(); ++i)
+    {
+        auto page = ui->tabWidget->widget(i);
+        if (page != ui->pageAbout)
+            clearPage(page);
+    }
+}
+
 void MainWindow::onPreparePage(int idx)
 {
     auto page = ui->tabWidget->widget(idx);
 
-    if (page->layout())
+    if (page == ui->pageAbout || page->layout())
     {
-        // Already prepared
+        // Already prepared, or being read
         return;
     }
 
-    bool ok = true;
-    if (page == ui->pageButtons1)
-        ok = prepareButtonsPage(page, kb, buttons[0]);
-    else if (page == ui->pageButtons2)
-        ok = prepareButtonsPage(page, kb, buttons[1]);
-    else if (page == ui->pageButtons3)
-        ok = prepareButtonsPage(page, kb, buttons[2]);
-    else if (page == ui->pageButtons4)
-        ok = prepareButtonsPage(page, kb, buttons[3]);
-    else if (page == ui->pageButtons5)
-        ok = prepareButtonsPage(page, kb, buttons[4]);
-    else if (page == ui->pageButtons6)
-        ok = prepareButtonsPage(page, kb, buttons[5]);
-    else if (page == ui->pageMacros)
-        ok = initPage(page, new PageMacro());
+    KbWidget *widget = nullptr;
+    std::vector<KB390L::PageId> pages;
+
+    if (page == ui->pageMacros)
+        widget = new PageMacro();
     else if (page == ui->pageSpeed)
-        ok = initPage(page, new PageSpeed());
+        widget = new PageSpeed();
     else if (page == ui->pageLight)
+        widget = new PageLight();
+    else
+        pages = {KB390L::PageId(KB390L::CmdButtons, 0), KB390L::PageId(KB390L::CmdEnabledButtons, 0)};
+
+    if (widget)
+        pages = widget->pages();
+
+    // Reading the pages here would block the UI, show a placeholder until the I/O thread is done.
+    auto layout = new QVBoxLayout;
+    layout->addWidget(new QLabel(tr("Reading the keyboard...")), 0, Qt::AlignCenter);
+    page->setLayout(layout);
+
+    pageRequests.insert(kb->readPagesAsync(pages), qMakePair(page, widget));
+}
+
+void MainWindow::buildPage(QWidget *parent, KbWidget *page, bool success)
+{
+    clearPage(parent);
+
+    bool ok = success;
+    if (!page)
     {
-        auto pageLight = new PageLight();
-        ok = initPage(page, pageLight);
-        connect(kb, SIGNAL(changed(KB390L*)), pageLight, SLOT(onKbChanged(KB390L*)));
+        QWidget *rows[] = {ui->pageButtons1, ui->pageButtons2, ui->pageButtons3, ui->pageButtons4,
+            ui->pageButtons5, ui->pageButtons6};
+
+        for (size_t i = 0; ok && i < sizeof(rows) / sizeof(rows[0]); ++i)
+        {
+            if (rows[i] == parent)
+            {
+                ok = prepareButtonsPage(parent, kb, buttons[i]);
+                break;
+            }
+        }
+    }
+    else if (!ok)
+    {
+        delete page;
+    }
+    else
+    {
+        auto pageLight = qobject_cast<PageLight *>(page);
+        ok = initPage(parent, page);
+
+        if (ok && pageLight)
+            connect(kb, SIGNAL(changed(KB390L*)), pageLight, SLOT(onKbChanged(KB390L*)));
     }
 
     if (!ok)
@@ -294,18 +455,24 @@ void MainWindow::onPreparePage(int idx)
 
 void MainWindow::closeEvent(QCloseEvent *evt)
 {
+    if (saveRequestId)
+    {
+        // Close the window once the save is finished.
+        closeAfterSave = true;
+        evt->ignore();
+        return;
+    }
+
     updatekb();
 
     if (kb->unsavedChanges()
         && QMessageBox::question(this, windowTitle(), tr("You have unsaved changes.\nSave them now?"))
                == QMessageBox::Yes)
     {
-        if (!kb->save())
-        {
-            QMessageBox::warning(this, windowTitle(), tr("Failed to save"));
-            evt->ignore();
-            return;
-        }
+        closeAfterSave = true;
+        onSave();
+        evt->ignore();
+        return;
     }
 
     QMainWindow::closeEvent(evt);
@@ -19,7 +19,9 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include <QHash>
 #include <QMainWindow>
+#include <QPair>
 
 QT_FORWARD_DECLARE_CLASS(QVBoxLayout)
 namespace Ui
@@ -31,7 +33,7 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = nullptr);
+    explicit MainWindow(const QString &devicePath = QString(), QWidget *parent = nullptr);
     ~MainWindow();
 
 protected:
@@ -43,13 +45,23 @@ public slots:
 
 private slots:
     void onPreparePage(int idx);
+    void onkbProgress(int requestId, int done, int total);
+    void onkbFinished(int requestId, bool success);
+    void onkbUnfinishedRestore();
 
 private:
     void updatekb();
     bool initPage(QWidget *parent, class KbWidget *page);
+    void buildPage(QWidget *parent, class KbWidget *page, bool success);
+    void resetPages();
 
     Ui::MainWindow *ui;
     class KB390L *kb;
+    int saveRequestId;
+    bool closeAfterSave;
+    int recoverRequestId;
+    // The tabs showing a placeholder until their pages are read on the I/O thread.
+    QHash<int, QPair<QWidget *, class KbWidget *>> pageRequests;
 };
 
 #endif // MAINWINDOW_H
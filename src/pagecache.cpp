@@ -0,0 +1,192 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "pagecache.h"
+#include "kb390l.h"
+
+static_assert(PageCache::FlagSize >= PageCache::ReportSize, "the flag does not fit its slot");
+
+// The flags cached, in slot order. Not the ping, it must reach the device.
+static const int flagCommands[PageCache::FlagCount] = {
+    KB390L::CmdReportRate,
+    KB390L::CmdResponseTime,
+    KB390L::CmdControl,
+    KB390L::CmdGameMode,
+};
+
+PageCache::PageCache()
+{
+    memset(current, 0, sizeof(current));
+    memset(base, 0, sizeof(base));
+}
+
+int PageCache::slot(int cacheId)
+{
+    int cmd = 0xFF & cacheId;
+    int idx = cacheId >> 8;
+
+    switch (cmd)
+    {
+    case KB390L::CmdButtons:
+        return idx == 0 ? SlotButtons : -1;
+    case KB390L::CmdEnabledButtons:
+        return idx == 0 ? SlotEnabledButtons : -1;
+    case KB390L::CmdMacro:
+        return idx >= KB390L::MinMacroNum && idx <= KB390L::MaxMacroNum ? SlotMacro + idx : -1;
+    }
+
+    for (int i = 0; idx == 0 && i < SlotCount - SlotFlag; ++i)
+    {
+        if (flagCommands[i] == cmd)
+            return SlotFlag + i;
+    }
+
+    return -1;
+}
+
+int PageCache::cacheId(int slot)
+{
+    if (slot == SlotButtons)
+        return KB390L::CmdButtons;
+    if (slot == SlotEnabledButtons)
+        return KB390L::CmdEnabledButtons;
+    if (slot < SlotFlag)
+        return (slot - SlotMacro) << 8 | KB390L::CmdMacro;
+    return flagCommands[slot - SlotFlag];
+}
+
+int PageCache::offset(int slot)
+{
+    if (slot == SlotButtons)
+        return 0;
+    if (slot == SlotEnabledButtons)
+        return ButtonsSize;
+    if (slot < SlotFlag)
+        return ButtonsSize + PageLayout::EnabledButtonsSize + (slot - SlotMacro) * MacroSize;
+    return ButtonsSize + PageLayout::EnabledButtonsSize + MacroSize * PageLayout::MacroCount
+        + (slot - SlotFlag) * FlagSize;
+}
+
+int PageCache::size(int slot)
+{
+    if (slot == SlotButtons)
+        return ButtonsSize;
+    if (slot == SlotEnabledButtons)
+        return PageLayout::EnabledButtonsSize;
+    if (slot < SlotFlag)
+        return MacroSize;
+    return ReportSize;
+}
+
+bool PageCache::isValid(int slot) const
+{
+    return valid.test(size_t(slot));
+}
+
+bool PageCache::isDirty(int slot) const
+{
+    return dirty.test(size_t(slot));
+}
+
+bool PageCache::anyDirty() const
+{
+    return dirty.any();
+}
+
+const char *PageCache::data(int slot) const
+{
+    return current + offset(slot);
+}
+
+const char *PageCache::baseline(int slot) const
+{
+    return base + offset(slot);
+}
+
+char *PageCache::modify(int slot)
+{
+    dirty.set(size_t(slot));
+    return current + offset(slot);
+}
+
+PageView PageCache::view(int slot) const
+{
+    return PageView(data(slot), size(slot));
+}
+
+QByteArray PageCache::page(int slot) const
+{
+    return QByteArray(data(slot), size(slot));
+}
+
+QByteArray PageCache::baselinePage(int slot) const
+{
+    return QByteArray(baseline(slot), size(slot));
+}
+
+static void copyPage(char *dst, int size, const PageView &value)
+{
+    auto length = qMin(size, value.size());
+    if (length > 0)
+        memcpy(dst, value.data(), size_t(length));
+    memset(dst + length, 0, size_t(size - length));
+}
+
+void PageCache::store(int slot, const QByteArray &value)
+{
+    store(slot, PageView(value));
+}
+
+void PageCache::store(int slot, const PageView &value)
+{
+    copyPage(current + offset(slot), size(slot), value);
+    memcpy(base + offset(slot), current + offset(slot), size_t(size(slot)));
+    valid.set(size_t(slot));
+    dirty.reset(size_t(slot));
+}
+
+void PageCache::commit(int slot, const QByteArray &written)
+{
+    if (!isValid(slot))
+    {
+        store(slot, written);
+        return;
+    }
+
+    copyPage(base + offset(slot), size(slot), PageView(written));
+    dirty.set(size_t(slot), memcmp(current + offset(slot), base + offset(slot), size_t(size(slot))) != 0);
+}
+
+void PageCache::update(int slot, const QByteArray &value)
+{
+    copyPage(current + offset(slot), size(slot), PageView(value));
+    valid.set(size_t(slot));
+    dirty.set(size_t(slot), memcmp(current + offset(slot), base + offset(slot), size_t(size(slot))) != 0);
+}
+
+void PageCache::invalidate(int slot)
+{
+    valid.reset(size_t(slot));
+    dirty.reset(size_t(slot));
+}
+
+void PageCache::clear()
+{
+    valid.reset();
+    dirty.reset();
+}
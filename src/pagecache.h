@@ -0,0 +1,176 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include "pagelayout.h"
+
+#include <QByteArray>
+
+#include <bitset>
+#include <string.h>
+
+// A non-owning view of a cached page. Valid until the page is stored again.
+class PageView
+{
+public:
+    PageView()
+        : ptr(nullptr)
+        , length(0)
+    {
+    }
+
+    PageView(const char *data, int size)
+        : ptr(data)
+        , length(size)
+    {
+    }
+
+    explicit PageView(const QByteArray &value)
+        : ptr(value.constData())
+        , length(value.length())
+    {
+    }
+
+    bool isNull() const
+    {
+        return ptr == nullptr;
+    }
+
+    const char *data() const
+    {
+        return ptr;
+    }
+
+    int size() const
+    {
+        return length;
+    }
+
+    char at(int i) const
+    {
+        return ptr[i];
+    }
+
+    const char *begin() const
+    {
+        return ptr;
+    }
+
+    const char *end() const
+    {
+        return ptr + length;
+    }
+
+    PageView mid(int pos, int len) const
+    {
+        return PageView(ptr + pos, len);
+    }
+
+    // A deep copy, for keeping the page beyond the view lifetime.
+    QByteArray toByteArray() const
+    {
+        return isNull() ? QByteArray() : QByteArray(ptr, length);
+    }
+
+    bool operator==(const PageView &other) const
+    {
+        return length == other.length && (length == 0 || memcmp(ptr, other.ptr, size_t(length)) == 0);
+    }
+
+    bool operator!=(const PageView &other) const
+    {
+        return !(*this == other);
+    }
+
+private:
+    const char *ptr;
+    int length;
+};
+
+// Fixed storage for every page the KB390L has: the flag reports, the button
+// table, the enabled buttons bitmap and the macros. Each page is kept twice:
+// the edited copy and the baseline (as the device has it).
+// Pages are addressed by slot, see slot() to map the (idx << 8 | cmd) id.
+class PageCache
+{
+public:
+    enum Constants
+    {
+        PageSize = PageLayout::PageSize,
+        ButtonsSize = PageLayout::ButtonsSize,
+        MacroSize = PageLayout::MacroSize,
+        ReportSize = PageLayout::ReportSize,
+        // A feature report, padded
+        FlagSize = 16,
+        FlagCount = 4,
+        StorageSize = ButtonsSize + PageLayout::EnabledButtonsSize + MacroSize * PageLayout::MacroCount
+            + FlagSize * FlagCount,
+    };
+
+    enum Slot
+    {
+        SlotButtons,
+        SlotEnabledButtons,
+        SlotMacro,
+        SlotFlag = SlotMacro + PageLayout::MacroCount,
+        SlotCount = SlotFlag + FlagCount,
+    };
+
+    PageCache();
+
+    // The slot of the page, or -1 if the page is not cached.
+    static int slot(int cacheId);
+    static int cacheId(int slot);
+    static int size(int slot);
+
+    bool isValid(int slot) const;
+    bool isDirty(int slot) const;
+    bool anyDirty() const;
+
+    const char *data(int slot) const;
+    const char *baseline(int slot) const;
+    // The page for in-place modification, marks it dirty.
+    char *modify(int slot);
+
+    PageView view(int slot) const;
+    QByteArray page(int slot) const;
+    QByteArray baselinePage(int slot) const;
+
+    // The page was read from the device.
+    void store(int slot, const QByteArray &value);
+    void store(int slot, const PageView &value);
+    // The page was written to the device. It stays dirty if modified since.
+    void commit(int slot, const QByteArray &written);
+    // Replace the edited copy, marks the page dirty if it differs from the baseline.
+    void update(int slot, const QByteArray &value);
+
+    void invalidate(int slot);
+    void clear();
+
+private:
+    static int offset(int slot);
+
+    alignas(int) char current[StorageSize];
+    alignas(int) char base[StorageSize];
+    std::bitset<SlotCount> valid;
+    std::bitset<SlotCount> dirty;
+};
+
+#endif // PAGECACHE_H
@@ -0,0 +1,183 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PAGELAYOUT_H
+#define PAGELAYOUT_H
+
+#include <QtEndian>
+
+// Compile time descriptors of the KB390L page formats. Every accessor is
+// resolved at compile time into a plain load or store at a fixed offset.
+
+// A scalar at the given byte offset: width in bytes, byte order and valid range.
+template <int Offset, int Width, int Min, int Max, bool BigEndian = false>
+struct PageField
+{
+    static_assert(Offset >= 0, "negative field offset");
+    static_assert(Width == 1 || Width == 2 || Width == 4, "unsupported field width");
+    static_assert(Min <= Max, "empty field range");
+
+    enum
+    {
+        offset = Offset,
+        width = Width,
+        end = Offset + Width,
+        minimum = Min,
+        maximum = Max,
+    };
+
+    static constexpr bool isValid(int value)
+    {
+        return value >= Min && value <= Max;
+    }
+
+    static int get(const char *page)
+    {
+        auto src = reinterpret_cast<const uchar *>(page + Offset);
+        switch (Width)
+        {
+        case 1:
+            return *src;
+        case 2:
+            return BigEndian ? qFromBigEndian<quint16>(src) : qFromLittleEndian<quint16>(src);
+        default:
+            return BigEndian ? qFromBigEndian<qint32>(src) : qFromLittleEndian<qint32>(src);
+        }
+    }
+
+    static void set(char *page, int value)
+    {
+        auto dst = reinterpret_cast<uchar *>(page + Offset);
+        switch (Width)
+        {
+        case 1:
+            *dst = uchar(value);
+            break;
+        case 2:
+            BigEndian ? qToBigEndian<quint16>(quint16(value), dst) : qToLittleEndian<quint16>(quint16(value), dst);
+            break;
+        default:
+            BigEndian ? qToBigEndian<qint32>(value, dst) : qToLittleEndian<qint32>(value, dst);
+            break;
+        }
+    }
+};
+
+// Count fields of the same type, one after another.
+template <int Offset, int Count, class Field>
+struct PageArray
+{
+    static_assert(Field::offset == 0, "the array element must start at zero");
+
+    enum
+    {
+        offset = Offset,
+        count = Count,
+        stride = Field::width,
+        end = Offset + Count * Field::width,
+    };
+
+    static int get(const char *page, int idx)
+    {
+        return Field::get(page + Offset + idx * stride);
+    }
+
+    static void set(char *page, int idx, int value)
+    {
+        Field::set(page + Offset + idx * stride, value);
+    }
+};
+
+// Rows of bits, each row takes Stride bytes with BitsPerRow of them used, LSB first.
+template <int Offset, int Rows, int Stride, int BitsPerRow>
+struct PageBitmap
+{
+    static_assert(BitsPerRow <= Stride * 8, "the row does not fit its stride");
+
+    enum
+    {
+        offset = Offset,
+        rows = Rows,
+        bitsPerRow = BitsPerRow,
+        size = Rows * Stride,
+        end = Offset + Rows * Stride,
+        count = Rows * BitsPerRow,
+    };
+
+    static bool get(const char *page, int idx)
+    {
+        return 0 != (page[byteOffset(idx)] & mask(idx));
+    }
+
+    static void set(char *page, int idx, bool value)
+    {
+        if (value)
+            page[byteOffset(idx)] |= mask(idx);
+        else
+            page[byteOffset(idx)] &= ~mask(idx);
+    }
+
+private:
+    static int byteOffset(int idx)
+    {
+        return Offset + idx / BitsPerRow * Stride + idx % BitsPerRow / 8;
+    }
+
+    static char mask(int idx)
+    {
+        return char(1 << (idx % BitsPerRow % 8));
+    }
+};
+
+struct PageLayout
+{
+    enum Sizes
+    {
+        PageSize = 64,
+        // A feature report: the report number, the command, 6 bytes of data and the checksum.
+        ReportSize = 9,
+        ButtonsSize = PageSize * 8,
+        EnabledButtonsSize = PageSize,
+        MacroSize = PageSize * 3,
+        MacroCount = 32,
+        // The raw NAND dump of the early versions: the buttons and all the macros.
+        LegacyBackupSize = ButtonsSize + MacroSize * MacroCount,
+    };
+
+    // The feature report data, the offsets include the report number & the command.
+    typedef PageField<2, 1, 0, 3> ReportRate;
+    typedef PageField<2, 1, 1, 10> ResponseTime;
+    typedef PageField<2, 1, 0, 1> GameMode;
+    typedef PageField<3, 1, 0, 240> LightType;
+    typedef PageField<4, 1, 0, 10> LightDelay;
+    typedef PageField<5, 1, 0, 50> LightBrightness;
+    typedef PageField<7, 1, 0, 4> LightDirection;
+
+    // The binding of every key, by its index.
+    typedef PageArray<0, ButtonsSize / 4, PageField<0, 4, -0x7FFFFFFF - 1, 0x7FFFFFFF>> Buttons;
+    // The keys, ButtonsPerRow per row.
+    typedef PageBitmap<0, 6, 3, 21> EnabledButtons;
+};
+
+static_assert(PageLayout::LightDirection::end < PageLayout::ReportSize, "the field overlaps the checksum");
+static_assert(PageLayout::Buttons::end <= PageLayout::ButtonsSize, "the button table does not fit its page");
+static_assert(PageLayout::EnabledButtons::end <= PageLayout::EnabledButtonsSize, "the bitmap does not fit its page");
+static_assert(PageLayout::ButtonsSize % PageLayout::PageSize == 0, "partial chunk");
+static_assert(PageLayout::MacroSize % PageLayout::PageSize == 0, "partial chunk");
+
+#endif // PAGELAYOUT_H
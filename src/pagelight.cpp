@@ -23,6 +23,7 @@
 PageLight::PageLight(QWidget *parent)
     : KbWidget(parent)
     , ui(new Ui::PageLight)
+    , reloadRequestId(0)
 {
     ui->setupUi(this);
 
@@ -43,6 +44,11 @@ PageLight::~PageLight()
     delete ui;
 }
 
+std::vector<KB390L::PageId> PageLight::pages() const
+{
+    return {KB390L::PageId(KB390L::CmdControl, 0)};
+}
+
 bool PageLight::load(KB390L *kb)
 {
     auto type = kb->lightType();
@@ -88,5 +94,19 @@ void PageLight::onLightTypeChanged(int value)
 
 void PageLight::onKbChanged(KB390L *kb)
 {
-    load(kb);
+    // Reread on the I/O thread, then load from the cache.
+    connect(kb, SIGNAL(finished(int,bool)), this, SLOT(onKbFinished(int,bool)), Qt::UniqueConnection);
+    reloadRequestId = kb->readPagesAsync(pages());
+}
+
+void PageLight::onKbFinished(int requestId, bool success)
+{
+    auto kb = qobject_cast<KB390L *>(sender());
+
+    if (kb && requestId == reloadRequestId)
+    {
+        reloadRequestId = 0;
+        if (success)
+            load(kb);
+    }
 }
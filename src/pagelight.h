@@ -33,15 +33,19 @@ public:
     explicit PageLight(QWidget *parent = 0);
     ~PageLight();
 
+    std::vector<KB390L::PageId> pages() const;
     bool load(class KB390L *kb);
     void save(class KB390L *kb);
 
 private slots:
     void onLightTypeChanged(int value);
     void onKbChanged(KB390L *kb);
+    void onKbFinished(int requestId, bool success);
 
 private:
     Ui::PageLight *ui;
+    // Rereading the flags changed on the keyboard.
+    int reloadRequestId;
 };
 
 #endif // PAGELIGHT_H
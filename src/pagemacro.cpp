@@ -53,10 +53,23 @@ PageMacro::~PageMacro()
     delete ui;
 }
 
+std::vector<KB390L::PageId> PageMacro::pages() const
+{
+    // Any of them can be selected.
+    std::vector<KB390L::PageId> ids;
+    for (int i = KB390L::MinMacroNum; i <= KB390L::MaxMacroNum; ++i)
+    {
+        ids.push_back(KB390L::PageId(KB390L::CmdMacro, i));
+    }
+
+    return ids;
+}
+
 bool PageMacro::load(KB390L *kb)
 {
     this->kb = kb;
-    auto macro = kb->macro(KB390L::MinMacroNum);
+    // Parsed in place, no copy of the page.
+    auto macro = kb->macroView(KB390L::MinMacroNum);
     if (macro.isNull())
         return false;
 
@@ -96,7 +109,7 @@ void PageMacro::selectMacro(QListWidgetItem *current, QListWidgetItem *previous)
     if (current)
     {
         auto macroIndex = current->data(QListWidgetItem::UserType).toInt();
-        auto macro = kb->macro(macroIndex);
+        auto macro = kb->macroView(macroIndex);
         if (macro.isNull())
         {
             QMessageBox::warning(this, windowTitle(), tr("Failed to load macro %1").arg(macroIndex, 3, 10, QChar('0')));
@@ -162,12 +175,17 @@ QByteArray PageMacro::macro() const
     return macro.append("\x0\x0", 192 - macro.size());
 }
 
-void PageMacro::setMacro(QByteArray &macro)
+void PageMacro::setMacro(const QByteArray &macro)
+{
+    setMacro(PageView(macro));
+}
+
+void PageMacro::setMacro(const PageView &macro)
 {
-    // Add some zeros to not bother about boundaries
-    macro.append("\x0\x0\x0\x0", 4);
+    // Read zeros past the end to not bother about boundaries
+    auto at = [&macro](int i) { return i < macro.size() ? macro.at(i) : char(0); };
 
-    auto count = (quint8)macro.at(0) << 8 | (quint8)macro.at(1);
+    auto count = (quint8)at(0) << 8 | (quint8)at(1);
     if (count == 0 || count == 0xFFFF)
     {
         // empty macro
@@ -175,10 +193,10 @@ void PageMacro::setMacro(QByteArray &macro)
     }
     ui->repeat->setValue(count);
 
-    for (int i = 2; i < macro.length(); i += 2)
+    for (int i = 2; i < macro.size(); i += 2)
     {
-        int delay = 0xFF & macro.at(i);
-        int value = 0xFF & macro.at(i + 1);
+        int delay = 0xFF & at(i);
+        int value = 0xFF & at(i + 1);
 
         if (value == 0)
         {
@@ -194,11 +212,11 @@ void PageMacro::setMacro(QByteArray &macro)
             type |= MacroEdit::ActionFlagUp;
             delay &= ~0x80;
         }
-        else if (macro.at(i + 3) == (char)value && (0x80 & macro.at(i + 2)) && delay == 1)
+        else if (at(i + 3) == (char)value && (0x80 & at(i + 2)) && delay == 1)
         {
             // Down, then up => key press / button click
             type |= MacroEdit::ActionFlagDown | MacroEdit::ActionFlagUp;
-            delay = 0x7F & macro.at(i + 2);
+            delay = 0x7F & at(i + 2);
             i += 2;
         }
         else
@@ -210,7 +228,7 @@ void PageMacro::setMacro(QByteArray &macro)
         // Check for extended delay
         if (delay == 0x7F)
         {
-            delay = (quint8)macro.at(i + 2) << 8 | (quint8)macro.at(i + 3);
+            delay = (quint8)at(i + 2) << 8 | (quint8)at(i + 3);
             i += 2;
         }
 
@@ -35,11 +35,13 @@ public:
     explicit PageMacro(QWidget *parent = 0);
     ~PageMacro();
 
+    std::vector<KB390L::PageId> pages() const;
     bool load(class KB390L *kb);
     void save(class KB390L *kb);
 
     QByteArray macro() const;
-    void setMacro(QByteArray& macro);
+    void setMacro(const QByteArray &macro);
+    void setMacro(const class PageView &macro);
 
 public slots:
     void addAction(int idx);
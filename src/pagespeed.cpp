@@ -35,6 +35,12 @@ PageSpeed::~PageSpeed()
     delete ui;
 }
 
+std::vector<KB390L::PageId> PageSpeed::pages() const
+{
+    return {KB390L::PageId(KB390L::CmdResponseTime, 0), KB390L::PageId(KB390L::CmdGameMode, 0),
+        KB390L::PageId(KB390L::CmdReportRate, 0)};
+}
+
 bool PageSpeed::load(KB390L *kb)
 {
     auto responseTime = kb->responseTime();
@@ -33,6 +33,7 @@ public:
     explicit PageSpeed(QWidget *parent = 0);
     ~PageSpeed();
 
+    std::vector<KB390L::PageId> pages() const;
     bool load(class KB390L *kb);
     void save(class KB390L *kb);
 
@@ -0,0 +1,221 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "profile.h"
+#include "kb390l.h"
+#include "pagecache.h"
+
+#include <QFileDevice>
+#include <QtEndian>
+
+#include <string.h>
+
+#define MAGIC "KBLP"
+
+// The size of the page as it is stored in the profile.
+static int sectionSize(int cacheId)
+{
+    auto slot = PageCache::slot(cacheId);
+    return slot < 0 ? -1 : PageCache::size(slot);
+}
+
+Profile::Profile()
+    : legacy(false)
+{
+}
+
+bool Profile::isEmpty() const
+{
+    return sections.empty();
+}
+
+bool Profile::isLegacy() const
+{
+    return legacy;
+}
+
+const std::map<int, QByteArray> &Profile::pages() const
+{
+    return sections;
+}
+
+QByteArray Profile::page(int cacheId) const
+{
+    auto iter = sections.find(cacheId);
+    return iter == sections.end() ? QByteArray() : iter->second;
+}
+
+void Profile::setPage(int cacheId, const QByteArray &data)
+{
+    sections[cacheId] = data;
+}
+
+QString Profile::device() const
+{
+    return deviceName;
+}
+
+void Profile::setDevice(const QString &device)
+{
+    deviceName = device;
+}
+
+bool Profile::loadLegacy(const char *data, qint64 size)
+{
+    // Buttons followed by all the macros.
+    if (size != PageLayout::LegacyBackupSize)
+        return false;
+
+    sections.clear();
+    deviceName.clear();
+    sections[KB390L::CmdButtons] = QByteArray(data, PageCache::ButtonsSize);
+    data += PageCache::ButtonsSize;
+
+    for (int i = KB390L::MinMacroNum; i <= KB390L::MaxMacroNum; ++i, data += PageCache::MacroSize)
+    {
+        sections[i << 8 | KB390L::CmdMacro] = QByteArray(data, PageCache::MacroSize);
+    }
+
+    legacy = true;
+    return true;
+}
+
+bool Profile::load(const char *data, qint64 size)
+{
+    if (size < HeaderSize || memcmp(data, MAGIC, 4) != 0)
+        return loadLegacy(data, size);
+
+    auto header = reinterpret_cast<const uchar *>(data);
+    auto version = qFromLittleEndian<quint16>(header + 4);
+    auto count = qFromLittleEndian<quint16>(header + 6);
+    auto tableCrc = qFromLittleEndian<quint16>(header + 8);
+
+    if (version > Version || HeaderSize + qint64(count) * SectionSize > size
+        || qChecksum(data + HeaderSize, uint(count * SectionSize)) != tableCrc)
+    {
+        return false;
+    }
+
+    std::map<int, QByteArray> loaded;
+    QString loadedDevice;
+    for (int i = 0; i < count; ++i)
+    {
+        auto entry = header + HeaderSize + i * SectionSize;
+        auto cacheId = int(qFromLittleEndian<quint16>(entry));
+        auto flags = qFromLittleEndian<quint16>(entry + 2);
+        auto offset = qint64(qFromLittleEndian<quint32>(entry + 4));
+        auto length = qint64(qFromLittleEndian<quint32>(entry + 8));
+        auto crc = qFromLittleEndian<quint16>(entry + 12);
+
+        if (offset < HeaderSize || offset + length > size || qChecksum(data + offset, uint(length)) != crc)
+            return false;
+
+        auto value = flags & SectionCompressed ? qUncompress(header + offset, int(length))
+                                               : QByteArray(data + offset, int(length));
+
+        if (cacheId == DeviceSection)
+        {
+            loadedDevice = QString::fromUtf8(value);
+            continue;
+        }
+
+        // Skip the pages this version does not know about.
+        auto expected = sectionSize(cacheId);
+        if (expected < 0)
+            continue;
+
+        if (value.length() != expected)
+            return false;
+
+        loaded[cacheId] = value;
+    }
+
+    sections.swap(loaded);
+    deviceName = loadedDevice;
+    legacy = false;
+    return true;
+}
+
+bool Profile::load(QIODevice *storage)
+{
+    auto file = qobject_cast<QFileDevice *>(storage);
+    if (file)
+    {
+        auto data = file->map(0, file->size());
+        if (data)
+        {
+            auto ok = load(reinterpret_cast<const char *>(data), file->size());
+            file->unmap(data);
+            return ok;
+        }
+    }
+
+    auto data = storage->readAll();
+    return load(data.constData(), data.size());
+}
+
+QByteArray Profile::save(bool compress) const
+{
+    auto all = sections;
+    if (!deviceName.isEmpty())
+        all[DeviceSection] = deviceName.toUtf8();
+
+    QByteArray table;
+    QByteArray payload;
+    auto dataOffset = HeaderSize + int(all.size()) * SectionSize;
+
+    foreach (auto section, all)
+    {
+        quint16 flags = 0;
+        auto value = section.second;
+
+        if (compress)
+        {
+            auto packed = qCompress(value);
+            if (packed.length() < value.length())
+            {
+                value = packed;
+                flags |= SectionCompressed;
+            }
+        }
+
+        uchar entry[SectionSize] = {};
+        qToLittleEndian<quint16>(quint16(section.first), entry);
+        qToLittleEndian<quint16>(flags, entry + 2);
+        qToLittleEndian<quint32>(quint32(dataOffset + payload.length()), entry + 4);
+        qToLittleEndian<quint32>(quint32(value.length()), entry + 8);
+        qToLittleEndian<quint16>(qChecksum(value.constData(), uint(value.length())), entry + 12);
+
+        table.append(reinterpret_cast<const char *>(entry), SectionSize);
+        payload.append(value);
+    }
+
+    uchar header[HeaderSize] = {};
+    memcpy(header, MAGIC, 4);
+    qToLittleEndian<quint16>(Version, header + 4);
+    qToLittleEndian<quint16>(quint16(all.size()), header + 6);
+    qToLittleEndian<quint16>(qChecksum(table.constData(), uint(table.length())), header + 8);
+
+    return QByteArray(reinterpret_cast<const char *>(header), HeaderSize) + table + payload;
+}
+
+bool Profile::save(QIODevice *storage, bool compress) const
+{
+    auto data = save(compress);
+    return storage->write(data) == data.length();
+}
@@ -0,0 +1,90 @@
+/*
+ *      Copyright 2018 Pavel Bludov <pbludov@gmail.com>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <map>
+
+class QIODevice;
+
+// The keyboard configuration as stored on disk.
+//
+// The file starts with a header, followed by the section table and the
+// section data. Every section holds one page (see PageCache::cacheId), has
+// its own checksum and may be compressed. All numbers are little endian.
+//
+//  Header:  "KBLP", u16 version, u16 sectionCount, u16 tableCrc, u16 reserved,
+//           u32 reserved
+//  Section: u16 cacheId, u16 flags, u32 offset, u32 length, u16 crc, u16 reserved
+//
+// The section DeviceSection holds the UTF-8 identity of the keyboard the
+// image belongs to, if any; the older versions skip it as an unknown page.
+//
+// The raw headerless dumps of the older versions (buttons + macros) are
+// accepted as well.
+class Profile
+{
+public:
+    enum Constants
+    {
+        Version = 1,
+        HeaderSize = 16,
+        SectionSize = 16,
+        DeviceSection = 0xFFFF,
+    };
+
+    enum SectionFlag
+    {
+        SectionCompressed = 0x01,
+    };
+
+    Profile();
+
+    bool isEmpty() const;
+    bool isLegacy() const;
+
+    // Pages by cache id.
+    const std::map<int, QByteArray> &pages() const;
+    QByteArray page(int cacheId) const;
+    void setPage(int cacheId, const QByteArray &data);
+
+    // The keyboard identity, see QHIDDevice::path().
+    QString device() const;
+    void setDevice(const QString &device);
+
+    // Validates the whole image in one pass, nothing is loaded on failure.
+    bool load(const char *data, qint64 size);
+    // Maps the file into memory when possible.
+    bool load(QIODevice *storage);
+
+    QByteArray save(bool compress = true) const;
+    bool save(QIODevice *storage, bool compress = true) const;
+
+private:
+    bool loadLegacy(const char *data, qint64 size);
+
+    std::map<int, QByteArray> sections;
+    QString deviceName;
+    bool legacy;
+};
+
+#endif // PROFILE_H